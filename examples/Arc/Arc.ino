@@ -0,0 +1,42 @@
+// Arc.ino
+//
+// Moves two steppers along a full circle of 2000 steps radius, followed by
+// a half circle back to the start, each as a single accelerated move.
+
+#include <InterruptStepper.h>
+#include <ArcInterpolator.h>
+
+void updateFunc() {}
+
+InterruptStepper stepper_x(Timer3, updateFunc, InterruptStepper::DRIVER, 13, 12);
+InterruptStepper stepper_y(Timer4, updateFunc, InterruptStepper::DRIVER, 11, 10);
+
+ArcInterpolator arc(Timer5, stepper_x, stepper_y);
+
+void setup() {
+  Serial.begin(9600);
+  arc.attachInterrupt([](){ arc.stepInterrupt(); });
+
+  // A full circle around (0, 2000), counterclockwise
+  arc.arcTo(0, 0, 0, 2000, false, 4000, 8000);
+  while (arc.isRunning())
+    ;
+  Serial.print("Full circle: ");
+  Serial.print(stepper_x.currentPosition());
+  Serial.print(", ");
+  Serial.println(stepper_y.currentPosition());
+
+  // Half a circle to (0, 4000) and back, clockwise
+  arc.arcTo(0, 4000, 0, 2000, true, 4000, 8000);
+  while (arc.isRunning())
+    ;
+  arc.arcTo(0, 0, 0, 2000, true, 4000, 8000);
+  while (arc.isRunning())
+    ;
+  Serial.print("Two half circles: ");
+  Serial.print(stepper_x.currentPosition());
+  Serial.print(", ");
+  Serial.println(stepper_y.currentPosition());
+}
+
+void loop() {}
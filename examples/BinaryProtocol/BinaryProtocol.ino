@@ -0,0 +1,37 @@
+// BinaryProtocol.ino
+//
+// Receives binary motion command frames over the native USB port and runs
+// them on a group of three steppers. The frames can be built on the host
+// using the MotionFrameEncoder class from MotionFrame.h, which doesn't
+// depend on Arduino.
+
+#include <InterruptStepper.h>
+#include <MotionProtocol.h>
+
+void updateFunc_1() {}
+void updateFunc_2() {}
+void updateFunc_3() {}
+
+InterruptStepper stepper_1(Timer1, updateFunc_1, InterruptStepper::DRIVER, 13, 12);
+InterruptStepper stepper_2(Timer2, updateFunc_2, InterruptStepper::DRIVER, 11, 10);
+InterruptStepper stepper_3(Timer3, updateFunc_3, InterruptStepper::DRIVER, 9, 8);
+
+StepperGroup group;
+MotionProtocol protocol(SerialUSB, group);
+
+void setup() {
+  // The baud rate is ignored by the native USB port
+  SerialUSB.begin(0);
+
+  stepper_1.attachInterrupt([](){ stepper_1.stepInterrupt(); });
+  stepper_2.attachInterrupt([](){ stepper_2.stepInterrupt(); });
+  stepper_3.attachInterrupt([](){ stepper_3.stepInterrupt(); });
+
+  group.addStepper(stepper_1);
+  group.addStepper(stepper_2);
+  group.addStepper(stepper_3);
+}
+
+void loop() {
+  protocol.poll();
+}
@@ -0,0 +1,52 @@
+// CoreXY.ino
+//
+// Streams G0/G1 moves sent over the serial port to a CoreXY machine. The
+// moves are given in the X and Y coordinates of the tool and converted into
+// the moves of the A and B motors by the kinematics.
+
+#include <InterruptStepper.h>
+#include <StepperGroup.h>
+#include <Kinematics.h>
+#include <GCodeStream.h>
+
+// Steps of X and Y per mm
+#define STEPS_PER_MM 80.0
+
+void updateFunc() {}
+
+InterruptStepper stepper_a(Timer3, updateFunc, InterruptStepper::DRIVER, 13, 12);
+InterruptStepper stepper_b(Timer4, updateFunc, InterruptStepper::DRIVER, 11, 10);
+
+StepperGroup group;
+CoreXYKinematics* kinematics;
+GCodeStream gcode(Serial, group);
+
+void setup() {
+  Serial.begin(115200);
+
+  stepper_a.attachInterrupt([](){ stepper_a.stepInterrupt(); });
+  stepper_b.attachInterrupt([](){ stepper_b.stepInterrupt(); });
+
+  group.addStepper(stepper_a);
+  group.addStepper(stepper_b);
+  // The kinematics is created once the group contains both motors
+  kinematics = new CoreXYKinematics(group);
+
+  gcode.setKinematics(*kinematics);
+  gcode.setAxis(0, 'X', STEPS_PER_MM);
+  gcode.setAxis(1, 'Y', STEPS_PER_MM);
+  gcode.setRapidFeedRate(6000);
+  gcode.setAcceleration(2000);
+}
+
+void loop() {
+  gcode.poll();
+
+  // Moves can also be queued directly, in steps of the axes
+  static bool moved = false;
+  if (!moved && millis() > 1000 && !group.isRunning()) {
+    long targets[] = { 800, 800 };
+    kinematics->queueMove(targets, 4000, 20000);
+    moved = true;
+  }
+}
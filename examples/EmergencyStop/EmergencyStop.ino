@@ -0,0 +1,73 @@
+// EmergencyStop.ino
+//
+// Measures the latency of the emergency stop, from the edge on the emergency
+// stop input to the last step made by any of the steppers. Connect
+// TRIGGER_PIN to ESTOP_PIN with a wire, so that the sketch can trigger the
+// emergency stop itself.
+
+#include <InterruptStepper.h>
+
+#define ESTOP_PIN 7
+#define TRIGGER_PIN 6
+
+void updateFunc_1() {}
+void updateFunc_2() {}
+void updateFunc_3() {}
+
+InterruptStepper stepper_1(Timer1, updateFunc_1, InterruptStepper::DRIVER, 13, 12);
+InterruptStepper stepper_2(Timer2, updateFunc_2, InterruptStepper::DRIVER, 11, 10);
+InterruptStepper stepper_3(Timer3, updateFunc_3, InterruptStepper::DRIVER, 9, 8);
+
+InterruptStepper* steppers[] = { &stepper_1, &stepper_2, &stepper_3 };
+
+// The worst latency (in μs) measured so far
+uint32_t worst_latency = 0;
+
+void setup() {
+  Serial.begin(9600);
+
+  stepper_1.attachInterrupt([](){ stepper_1.stepInterrupt(); });
+  stepper_2.attachInterrupt([](){ stepper_2.stepInterrupt(); });
+  stepper_3.attachInterrupt([](){ stepper_3.stepInterrupt(); });
+
+  for (InterruptStepper* stepper : steppers) {
+    stepper->setMaxSpeed(20000);
+    stepper->setAcceleration(20000);
+  }
+
+  pinMode(TRIGGER_PIN, OUTPUT);
+  digitalWrite(TRIGGER_PIN, HIGH);
+  InterruptStepper::attachEmergencyStop(ESTOP_PIN, FALLING, 
+                                        InterruptStepper::EMERGENCY_HALT);
+}
+
+void loop() {
+  // Start all the steppers and trigger the emergency stop at a random moment
+  for (InterruptStepper* stepper : steppers)
+    stepper->move(1000000);
+  delay(random(500, 1500));
+  digitalWrite(TRIGGER_PIN, LOW);
+  delay(100);
+
+  // The latency is the time from the emergency stop being triggered to the
+  // start of the last step interrupt of any of the steppers
+  uint32_t latency = 0;
+  for (InterruptStepper* stepper : steppers) {
+    int32_t since_trigger = stepper->lastStepTime() - InterruptStepper::emergencyStopTime();
+    if (since_trigger > (int32_t)latency)
+      latency = since_trigger;
+  }
+  if (latency > worst_latency)
+    worst_latency = latency;
+
+  Serial.print("Latency: ");
+  Serial.print(latency);
+  Serial.print(" us, worst: ");
+  Serial.print(worst_latency);
+  Serial.println(" us");
+
+  digitalWrite(TRIGGER_PIN, HIGH);
+  InterruptStepper::resetEmergencyStop();
+  for (InterruptStepper* stepper : steppers)
+    stepper->setCurrentPosition(0);
+}
@@ -0,0 +1,109 @@
+// EngineBenchmark.ino
+//
+// Compares running 1 to 9 steppers with their own timers and with a single
+// StepEngine ticking at 100 kHz. For every number of steppers the sketch
+// prints the worst step jitter of all the steppers and the CPU load, which is
+// measured by counting how many times the loop below runs while the steppers
+// are running, compared to when they're stationary.
+
+#include <InterruptStepper.h>
+#include <StepEngine.h>
+
+#define SPEED 5000
+// How long (in ms) each measurement takes
+#define MEASUREMENT_TIME 1000
+
+void updateFunc() {}
+
+InterruptStepper stepper_0(Timer0, updateFunc, InterruptStepper::DRIVER, 22, 23);
+InterruptStepper stepper_1(Timer1, updateFunc, InterruptStepper::DRIVER, 24, 25);
+InterruptStepper stepper_2(Timer2, updateFunc, InterruptStepper::DRIVER, 26, 27);
+InterruptStepper stepper_3(Timer3, updateFunc, InterruptStepper::DRIVER, 28, 29);
+InterruptStepper stepper_4(Timer4, updateFunc, InterruptStepper::DRIVER, 30, 31);
+InterruptStepper stepper_5(Timer5, updateFunc, InterruptStepper::DRIVER, 32, 33);
+InterruptStepper stepper_6(Timer6, updateFunc, InterruptStepper::DRIVER, 34, 35);
+InterruptStepper stepper_7(Timer7, updateFunc, InterruptStepper::DRIVER, 36, 37);
+InterruptStepper stepper_8(Timer8, updateFunc, InterruptStepper::DRIVER, 38, 39);
+
+InterruptStepper* steppers[] = { &stepper_0, &stepper_1, &stepper_2, 
+                                 &stepper_3, &stepper_4, &stepper_5, 
+                                 &stepper_6, &stepper_7, &stepper_8 };
+
+// The engine reuses Timer0 once the steppers stop using their own timers
+StepEngine engine(Timer0, 10);
+
+// Number of loop iterations per measurement with all the steppers stopped
+uint32_t idle_count;
+
+uint32_t countLoops() {
+  uint32_t count = 0;
+  uint32_t start = millis();
+  while (millis() - start < MEASUREMENT_TIME)
+    count++;
+  return count;
+}
+
+void measure(const char* mode, uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    steppers[i]->setCurrentPosition(0);
+    steppers[i]->moveTo(1000000);
+  }
+  // Wait until the steppers reach their max speed
+  delay(500);
+  for (uint8_t i = 0; i < count; i++)
+    steppers[i]->resetStepJitter();
+
+  uint32_t loops = countLoops();
+
+  uint32_t jitter = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    jitter = max(jitter, steppers[i]->maxStepJitter());
+    steppers[i]->setCurrentPosition(0);
+  }
+
+  Serial.print(mode);
+  Serial.print(", ");
+  Serial.print(count);
+  Serial.print(" steppers: jitter ");
+  Serial.print(jitter);
+  Serial.print(" us, CPU load ");
+  Serial.print(100.0 * (1.0 - (float)loops / idle_count), 1);
+  Serial.println("%");
+}
+
+void setup() {
+  Serial.begin(9600);
+
+  stepper_0.attachInterrupt([](){ stepper_0.stepInterrupt(); });
+  stepper_1.attachInterrupt([](){ stepper_1.stepInterrupt(); });
+  stepper_2.attachInterrupt([](){ stepper_2.stepInterrupt(); });
+  stepper_3.attachInterrupt([](){ stepper_3.stepInterrupt(); });
+  stepper_4.attachInterrupt([](){ stepper_4.stepInterrupt(); });
+  stepper_5.attachInterrupt([](){ stepper_5.stepInterrupt(); });
+  stepper_6.attachInterrupt([](){ stepper_6.stepInterrupt(); });
+  stepper_7.attachInterrupt([](){ stepper_7.stepInterrupt(); });
+  stepper_8.attachInterrupt([](){ stepper_8.stepInterrupt(); });
+
+  for (InterruptStepper* stepper : steppers) {
+    stepper->setMaxSpeed(SPEED);
+    stepper->setAcceleration(50000);
+  }
+
+  idle_count = countLoops();
+
+  for (uint8_t count = 1; count <= 9; count++)
+    measure("Own timers", count);
+
+  // Hand all the steppers over to the engine
+  engine.attachInterrupt([](){ engine.tick(); });
+  for (InterruptStepper* stepper : steppers)
+    engine.addStepper(*stepper);
+  // The load includes the ticks of the engine, which run even when no
+  // stepper is moving
+  engine.begin();
+
+  for (uint8_t count = 1; count <= 9; count++)
+    measure("Engine", count);
+}
+
+void loop() {}
@@ -0,0 +1,65 @@
+// FeedHold.ino
+//
+// Runs two steppers through a queue of moves that can be paused and resumed
+// with a button. The hold is started from the button's interrupt, so the
+// steppers start slowing down at once, no matter what the main loop is
+// doing. The steppers stay on their path while slowing down and resume the
+// same moves afterwards.
+
+#include <InterruptStepper.h>
+#include <StepperGroup.h>
+
+// Button connected between the pin and GND
+#define HOLD_PIN 2
+
+void updateFunc() {}
+
+InterruptStepper stepper_1(Timer3, updateFunc, InterruptStepper::DRIVER, 13, 12);
+InterruptStepper stepper_2(Timer4, updateFunc, InterruptStepper::DRIVER, 11, 10);
+
+StepperGroup group;
+
+void holdPressed() {
+  // Ignore the bouncing of the button
+  static uint32_t last_press = 0;
+  if (millis() - last_press < 50)
+    return;
+  last_press = millis();
+
+  if (group.isHolding())
+    group.resume();
+  else
+    group.hold();
+}
+
+void setup() {
+  Serial.begin(115200);
+
+  stepper_1.attachInterrupt([](){ stepper_1.stepInterrupt(); });
+  stepper_2.attachInterrupt([](){ stepper_2.stepInterrupt(); });
+
+  group.addStepper(stepper_1);
+  group.addStepper(stepper_2);
+
+  pinMode(HOLD_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(HOLD_PIN), holdPressed, FALLING);
+}
+
+void loop() {
+  // Keep the queue full of moves back and forth
+  static long distance = 4000;
+  if (group.queueSpace() > 0) {
+    long targets[] = { distance, distance / 2 };
+    group.queueMove(targets, 2000, 4000);
+    distance = -distance;
+  }
+
+  static uint32_t last_print = 0;
+  if (millis() - last_print > 500) {
+    last_print = millis();
+    Serial.print(group.isHeld() ? "Held at " : "Running at ");
+    Serial.print(stepper_1.currentPosition());
+    Serial.print(", ");
+    Serial.println(stepper_2.currentPosition());
+  }
+}
@@ -0,0 +1,37 @@
+// GCode.ino
+//
+// Streams G0/G1 moves sent over the serial port to a group of two steppers.
+// After every line the sketch answers with "ok", so the sender should wait
+// for it before sending the next line.
+
+#include <InterruptStepper.h>
+#include <GCodeStream.h>
+
+void updateFunc_x() {}
+void updateFunc_y() {}
+
+InterruptStepper stepper_x(Timer1, updateFunc_x, InterruptStepper::DRIVER, 13, 12);
+InterruptStepper stepper_y(Timer2, updateFunc_y, InterruptStepper::DRIVER, 11, 10);
+
+StepperGroup group;
+GCodeStream gcode(Serial, group);
+
+void setup() {
+  Serial.begin(115200);
+
+  stepper_x.attachInterrupt([](){ stepper_x.stepInterrupt(); });
+  stepper_y.attachInterrupt([](){ stepper_y.stepInterrupt(); });
+
+  group.addStepper(stepper_x);
+  group.addStepper(stepper_y);
+
+  // 80 steps per mm on both axes
+  gcode.setAxis(0, 'X', 80);
+  gcode.setAxis(1, 'Y', 80);
+  gcode.setRapidFeedRate(6000);
+  gcode.setAcceleration(500);
+}
+
+void loop() {
+  gcode.poll();
+}
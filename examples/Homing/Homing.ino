@@ -0,0 +1,52 @@
+// Homing.ino
+//
+// Homing the stepper using an endstop. The endstop is checked in the
+// interrupt after every step, so the motor stops within one step of the
+// endstop being triggered, regardless of what happens in the main loop.
+
+#include <InterruptStepper.h>
+
+#define STEP_PIN 13
+#define DIR_PIN 12
+// Endstop switch connected between this pin and GND
+#define ENDSTOP_PIN 8
+
+void updateFunc() {}
+
+InterruptStepper stepper(Timer3, updateFunc, InterruptStepper::DRIVER, STEP_PIN, DIR_PIN);
+
+void setup() {
+  Serial.begin(9600);
+
+  stepper.attachInterrupt([](){ stepper.stepInterrupt(); });
+
+  stepper.setMaxSpeed(2000);
+  stepper.setAcceleration(4000);
+
+  // The endstop pulls the pin LOW when triggered
+  stepper.setEndstop(ENDSTOP_PIN, LOW);
+}
+
+void loop() {
+  // Home counterclockwise: approach the endstop at 1000 steps/s, back off by
+  // 200 steps and approach it again at 100 steps/s
+  stepper.home(0, 1000, 100, 200);
+
+  while (stepper.homingState() != InterruptStepper::HOMING_DONE &&
+         stepper.homingState() != InterruptStepper::HOMING_FAILED) {}
+
+  if (stepper.homingState() == InterruptStepper::HOMING_FAILED) {
+    Serial.println("Homing failed");
+    while (true) {}
+  }
+
+  // The trigger position shows how far the motor got from the previous home
+  // position, so it should stay close to 0 between subsequent homings
+  Serial.print("Endstop triggered at: ");
+  Serial.println(stepper.homingTriggerPosition());
+
+  // Move away from the endstop before homing again
+  stepper.moveTo(3000);
+  while (stepper.isRunning()) {}
+  delay(1000);
+}
@@ -0,0 +1,103 @@
+// IsrCycles.ino
+//
+// Measures how many CPU cycles the step interrupts take, using the cycle
+// counter of the Cortex-M3. Upload the sketch once as it is and once with
+// INTERRUPT_STEPPER_RUN_FROM_RAM defined in InterruptStepperConfig.h, then
+// compare the printed cycle counts and the RAM used by the code and the
+// initialized variables.
+
+#include <InterruptStepper.h>
+#include <LeanStepper.h>
+
+// Start and end of the RAM section holding the initialized variables and
+// the code copied from flash (defined by the Due's linker script)
+extern "C" char _srelocate, _erelocate;
+
+void updateFunc() {}
+
+InterruptStepper stepper(Timer1, updateFunc, InterruptStepper::DRIVER, 13, 12);
+LeanStepper lean_stepper(Timer2, 11, 10);
+
+// Cycle statistics of both steppers' interrupts
+struct Cycles {
+  volatile uint32_t count;
+  volatile uint32_t total;
+  volatile uint32_t lowest;
+  volatile uint32_t highest;
+
+  void add(uint32_t cycles) {
+    count++;
+    total += cycles;
+    if (cycles < lowest) lowest = cycles;
+    if (cycles > highest) highest = cycles;
+  }
+
+  void reset() {
+    count = 0;
+    total = 0;
+    lowest = 0xffffffff;
+    highest = 0;
+  }
+
+  void print(const char* name) {
+    noInterrupts();
+    uint32_t c = count, t = total, lo = lowest, hi = highest;
+    reset();
+    interrupts();
+    Serial.print(name);
+    Serial.print(": min ");
+    Serial.print(lo);
+    Serial.print(", avg ");
+    Serial.print(c ? t / c : 0);
+    Serial.print(", max ");
+    Serial.print(hi);
+    Serial.println(" cycles");
+  }
+} cycles, lean_cycles;
+
+void setup() {
+  Serial.begin(9600);
+
+  // Enable the cycle counter
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  stepper.attachInterrupt([](){
+    uint32_t start = DWT->CYCCNT;
+    stepper.stepInterrupt();
+    cycles.add(DWT->CYCCNT - start);
+  });
+  lean_stepper.attachInterrupt([](){
+    uint32_t start = DWT->CYCCNT;
+    lean_stepper.stepInterrupt();
+    lean_cycles.add(DWT->CYCCNT - start);
+  });
+
+  stepper.setMaxSpeed(10000);
+  stepper.setAcceleration(10000);
+  lean_stepper.setMaxSpeed(10000);
+  lean_stepper.setAcceleration(10000);
+  cycles.reset();
+  lean_cycles.reset();
+
+#ifdef INTERRUPT_STEPPER_RUN_FROM_RAM
+  Serial.println("Step interrupts run from RAM");
+#else
+  Serial.println("Step interrupts run from flash");
+#endif
+  Serial.print("Relocated to RAM: ");
+  Serial.print((uint32_t)(&_erelocate - &_srelocate));
+  Serial.println(" bytes");
+}
+
+void loop() {
+  if (!stepper.isRunning())
+    stepper.moveTo(stepper.currentPosition() > 0 ? 0 : 50000);
+  if (!lean_stepper.isRunning())
+    lean_stepper.moveTo(lean_stepper.currentPosition() > 0 ? 0 : 50000);
+
+  delay(1000);
+  cycles.print("InterruptStepper");
+  lean_cycles.print("LeanStepper");
+}
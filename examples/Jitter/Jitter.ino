@@ -0,0 +1,65 @@
+// Jitter.ino
+//
+// Shows the worst-case step jitter of every stepper while a slow stepper
+// with a long update function competes with two fast ones. The steppers
+// first run with the default (equal) interrupt priorities and then with the
+// priorities assigned by their max speed.
+
+#include <InterruptStepper.h>
+
+void updateFunc_1() {}
+void updateFunc_2() {}
+// Simulates a slow stepper doing a lot of work after every step
+void updateFunc_3() { delayMicroseconds(40); }
+
+InterruptStepper stepper_1(Timer1, updateFunc_1, InterruptStepper::DRIVER, 13, 12);
+InterruptStepper stepper_2(Timer2, updateFunc_2, InterruptStepper::DRIVER, 11, 10);
+InterruptStepper stepper_3(Timer3, updateFunc_3, InterruptStepper::DRIVER, 9, 8);
+
+InterruptStepper* steppers[] = { &stepper_1, &stepper_2, &stepper_3 };
+
+void measure() {
+  for (InterruptStepper* stepper : steppers) {
+    stepper->setCurrentPosition(0);
+    stepper->move(20000);
+  }
+  // Only measure the jitter at constant speed
+  delay(1500);
+  for (InterruptStepper* stepper : steppers)
+    stepper->resetStepJitter();
+  delay(1000);
+
+  for (int i = 0; i < 3; i++) {
+    Serial.print("  stepper ");
+    Serial.print(i + 1);
+    Serial.print(" (priority ");
+    Serial.print(steppers[i]->interruptPriority());
+    Serial.print("): ");
+    Serial.print(steppers[i]->maxStepJitter());
+    Serial.println(" us");
+  }
+  while (stepper_1.run() || stepper_2.run() || stepper_3.run());
+}
+
+void setup() {
+  Serial.begin(9600);
+
+  stepper_1.attachInterrupt([](){ stepper_1.stepInterrupt(); });
+  stepper_2.attachInterrupt([](){ stepper_2.stepInterrupt(); });
+  stepper_3.attachInterrupt([](){ stepper_3.stepInterrupt(); });
+
+  stepper_1.setMaxSpeed(8000);
+  stepper_2.setMaxSpeed(5000);
+  stepper_3.setMaxSpeed(1000);
+  for (InterruptStepper* stepper : steppers)
+    stepper->setAcceleration(20000);
+
+  Serial.println("Equal priorities:");
+  measure();
+
+  InterruptStepper::assignInterruptPriorities();
+  Serial.println("Priorities by max speed:");
+  measure();
+}
+
+void loop() {}
@@ -0,0 +1,40 @@
+// Lean.ino
+//
+// Running many axes with LeanSteppers, which keep only the state needed for
+// accelerated moves of step/dir drivers
+
+#include <LeanStepper.h>
+
+LeanStepper stepper_1(Timer1, 13, 12);
+LeanStepper stepper_2(Timer2, 11, 10);
+LeanStepper stepper_3(Timer3, 9, 8);
+LeanStepper stepper_4(Timer4, 7, 6);
+LeanStepper stepper_5(Timer5, 5, 4);
+LeanStepper stepper_6(Timer6, 3, 2);
+
+LeanStepper* steppers[] = { &stepper_1, &stepper_2, &stepper_3, 
+                            &stepper_4, &stepper_5, &stepper_6 };
+
+void setup() {
+  stepper_1.attachInterrupt([](){ stepper_1.stepInterrupt(); });
+  stepper_2.attachInterrupt([](){ stepper_2.stepInterrupt(); });
+  stepper_3.attachInterrupt([](){ stepper_3.stepInterrupt(); });
+  stepper_4.attachInterrupt([](){ stepper_4.stepInterrupt(); });
+  stepper_5.attachInterrupt([](){ stepper_5.stepInterrupt(); });
+  stepper_6.attachInterrupt([](){ stepper_6.stepInterrupt(); });
+
+  for (LeanStepper* stepper : steppers) {
+    stepper->setMaxSpeed(10000);
+    stepper->setAcceleration(20000);
+    // DRV8825 drivers need step pulses of at least 1.9μs
+    stepper->setMinPulseWidth(2);
+  }
+}
+
+void loop() {
+  // Move every axis back and forth by a different distance
+  for (int i = 0; i < 6; i++) {
+    if (!steppers[i]->isRunning())
+      steppers[i]->moveTo(steppers[i]->currentPosition() > 0 ? 0 : 4000 * (i + 1));
+  }
+}
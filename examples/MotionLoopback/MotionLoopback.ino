@@ -0,0 +1,150 @@
+// MotionLoopback.ino
+//
+// Tests the binary motion protocol without a host. The frames are built with
+// MotionFrameEncoder, just like a host would build them, and fed to a
+// MotionProtocol through a loopback stream, which also collects the
+// acknowledgements. The result of every check is printed to the serial
+// monitor.
+
+#include <InterruptStepper.h>
+#include <MotionProtocol.h>
+
+// A stream whose input is fed by the sketch and whose output is kept for the
+// sketch to read back
+class LoopbackStream : public Stream {
+public:
+  // Makes the bytes readable by the protocol
+  void feed(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length && _in_end < sizeof(_in); i++)
+      _in[_in_end++] = data[i];
+  }
+
+  // Takes the oldest acknowledgement written by the protocol. Returns false
+  // if there is none.
+  bool takeAck(uint8_t ack[]) {
+    if (_out_end - _out_start < MOTION_ACK_LENGTH)
+      return false;
+    memcpy(ack, _out + _out_start, MOTION_ACK_LENGTH);
+    _out_start += MOTION_ACK_LENGTH;
+    return true;
+  }
+
+  int available() override { return _in_end - _in_start; }
+  int read() override { return _in_start < _in_end ? _in[_in_start++] : -1; }
+  int peek() override { return _in_start < _in_end ? _in[_in_start] : -1; }
+  void flush() override {}
+  size_t write(uint8_t c) override {
+    if (_out_end == sizeof(_out))
+      return 0;
+    _out[_out_end++] = c;
+    return 1;
+  }
+  using Print::write;
+
+private:
+  uint8_t _in[1024];
+  size_t _in_start = 0;
+  size_t _in_end = 0;
+  uint8_t _out[256];
+  size_t _out_start = 0;
+  size_t _out_end = 0;
+};
+
+void updateFunc_1() {}
+void updateFunc_2() {}
+
+InterruptStepper stepper_1(Timer1, updateFunc_1, InterruptStepper::DRIVER, 13, 12);
+InterruptStepper stepper_2(Timer2, updateFunc_2, InterruptStepper::DRIVER, 11, 10);
+
+StepperGroup group;
+LoopbackStream loopback;
+MotionProtocol protocol(loopback, group);
+
+uint8_t frame[MOTION_MAX_FRAME];
+MotionFrameEncoder encoder(frame);
+uint8_t failures = 0;
+
+void check(const char* name, bool passed) {
+  Serial.print(passed ? "PASS " : "FAIL ");
+  Serial.println(name);
+  if (!passed)
+    failures++;
+}
+
+// Feeds the bytes to the protocol and returns the status of the
+// acknowledgement, or -1 if there was none or it was corrupted
+int exchange(const uint8_t* data, size_t length, uint8_t sequence) {
+  loopback.feed(data, length);
+  protocol.poll();
+  uint8_t ack[MOTION_ACK_LENGTH];
+  if (!loopback.takeAck(ack))
+    return -1;
+  uint16_t crc = ack[4] | (ack[5] << 8);
+  if (ack[0] != MOTION_ACK_START || ack[1] != sequence
+      || motionCrc16(ack + 1, 3) != crc)
+    return -1;
+  return ack[2];
+}
+
+// Builds a frame with a single move, preceded by the speed and acceleration
+size_t moveFrame(uint8_t sequence, float speed, float acceleration,
+                 int32_t x, int32_t y) {
+  int32_t targets[] = { x, y };
+  encoder.begin(sequence);
+  encoder.speed(speed);
+  encoder.acceleration(acceleration);
+  encoder.move(targets, 2);
+  return encoder.end();
+}
+
+void setup() {
+  Serial.begin(9600);
+
+  stepper_1.attachInterrupt([](){ stepper_1.stepInterrupt(); });
+  stepper_2.attachInterrupt([](){ stepper_2.stepInterrupt(); });
+  group.addStepper(stepper_1);
+  group.addStepper(stepper_2);
+
+  // A valid frame is executed
+  size_t length = moveFrame(1, 1000, 2000, 400, 200);
+  check("valid frame", exchange(frame, length, 1) == MOTION_OK);
+  check("valid frame executed", protocol.framesExecuted() == 1);
+
+  // A repeated frame is acknowledged, but not executed again
+  check("repeated frame", exchange(frame, length, 1) == MOTION_OK);
+  check("repeated frame not executed", protocol.framesExecuted() == 1);
+
+  // A corrupted byte is caught by the CRC
+  length = moveFrame(2, 1000, 2000, 0, 0);
+  frame[6] ^= 0x10;
+  check("bad CRC", exchange(frame, length, 2) == MOTION_BAD_CRC);
+  check("bad CRC not executed", protocol.framesExecuted() == 1);
+
+  // A frame cut short swallows the start of the next one, which fails the
+  // CRC. The host resends the frame that wasn't acknowledged.
+  length = moveFrame(3, 1000, 2000, 100, 100);
+  check("truncated frame", exchange(frame, length - 4, 3) == -1);
+  length = moveFrame(4, 1000, 2000, 0, 0);
+  check("frame after the truncated one",
+        exchange(frame, length, 3) == MOTION_BAD_CRC);
+  check("resent frame", exchange(frame, length, 4) == MOTION_OK);
+  check("only the resent frame executed", protocol.framesExecuted() == 2);
+
+  // Speeds and accelerations that can't be planned are rejected
+  length = moveFrame(5, 0, 2000, 100, 100);
+  check("zero speed", exchange(frame, length, 5) == MOTION_BAD_COMMAND);
+  length = moveFrame(6, -1000, 2000, 100, 100);
+  check("negative speed", exchange(frame, length, 6) == MOTION_BAD_COMMAND);
+  length = moveFrame(7, NAN, 2000, 100, 100);
+  check("NaN speed", exchange(frame, length, 7) == MOTION_BAD_COMMAND);
+  length = moveFrame(8, 1000, 0, 100, 100);
+  check("zero acceleration", exchange(frame, length, 8) == MOTION_BAD_COMMAND);
+  length = moveFrame(9, 1000, -INFINITY, 100, 100);
+  check("infinite acceleration",
+        exchange(frame, length, 9) == MOTION_BAD_COMMAND);
+  check("rejected frames not executed", protocol.framesExecuted() == 2);
+
+  Serial.println(failures == 0 ? "All checks passed" : "Some checks failed");
+}
+
+void loop() {}
@@ -0,0 +1,56 @@
+// Shaping.ino
+//
+// Makes the same move with and without input shaping and prints the step
+// timeline of both: the time (in ms) since the start of the move, the
+// position and the speed every 5 ms. The shaped move lags behind by the
+// duration of the shaper, but its speed changes are spread over a period of
+// the resonance, so they don't make the machine ring.
+
+#include <InterruptStepper.h>
+
+#define STEP_PIN 13
+#define DIR_PIN 12
+#define DISTANCE 4000
+// Resonance of the machine to cancel
+#define FREQUENCY 40.0
+#define DAMPING 0.1
+
+void updateFunc() {}
+
+InterruptStepper stepper(Timer3, updateFunc, InterruptStepper::DRIVER, STEP_PIN, DIR_PIN);
+InputShaper shaper(InputShaper::ZVD, FREQUENCY, DAMPING);
+
+void printTimeline(long target) {
+  uint32_t start = millis();
+  stepper.moveTo(target);
+  do {
+    Serial.print(millis() - start);
+    Serial.print("\t");
+    Serial.print(stepper.currentPosition());
+    Serial.print("\t");
+    Serial.println(stepper.speed());
+    delay(5);
+  } while (stepper.isRunning());
+}
+
+void setup() {
+  Serial.begin(115200);
+
+  stepper.attachInterrupt([](){ stepper.stepInterrupt(); });
+  stepper.setMaxSpeed(4000);
+  stepper.setAcceleration(40000);
+  stepper.setVelocityMode(true);
+  InterruptStepper::startVelocityLoop(Timer4, 1000);
+
+  Serial.println("Unshaped:");
+  printTimeline(DISTANCE);
+  delay(500);
+
+  Serial.print("Shaped, duration ");
+  Serial.print(shaper.duration() * 1000.0);
+  Serial.println(" ms:");
+  stepper.setInputShaper(&shaper);
+  printTimeline(0);
+}
+
+void loop() {}
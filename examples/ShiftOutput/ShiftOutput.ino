@@ -0,0 +1,51 @@
+// ShiftOutput.ino
+//
+// Running 16 steppers whose step and direction inputs are connected to a
+// chain of four 74HC595 shift registers instead of the Due's pins. The
+// first register's serial input is connected to pin A0, the shift clocks of
+// all the registers to pin 23 and the storage clocks to pin 24. Outputs 0
+// and 1 of the chain are the step and direction of the first driver,
+// outputs 2 and 3 of the second one and so on.
+
+#include <InterruptStepper.h>
+#include <StepEngine.h>
+
+#define AXES 16
+
+void updateFunc() {}
+
+// 32 outputs, shifted at 10.5 MHz
+ShiftOutput chain(2 * AXES);
+
+// The pins and timers of the steppers aren't used, so they can all share
+// Timer0. `enable` is false so that the pins aren't configured.
+InterruptStepper* steppers[AXES];
+
+StepEngine engine(Timer1, 10);
+
+void setup() {
+  Serial.begin(9600);
+  chain.begin();
+
+  engine.attachInterrupt([](){ engine.tick(); });
+  if (!engine.setShiftOutput(chain))
+    Serial.println("The chain takes longer to update than a tick");
+
+  for (uint8_t i = 0; i < AXES; i++) {
+    steppers[i] = new InterruptStepper(Timer0, updateFunc, 
+                                       InterruptStepper::DRIVER, 0, 0, 0, 0, 
+                                       false);
+    engine.addStepper(*steppers[i]);
+    steppers[i]->setShiftOutput(chain, 2 * i);
+    steppers[i]->setMaxSpeed(1000 + 500 * i);
+    steppers[i]->setAcceleration(2000);
+  }
+  engine.begin();
+}
+
+void loop() {
+  for (uint8_t i = 0; i < AXES; i++) {
+    if (!steppers[i]->isRunning())
+      steppers[i]->moveTo(steppers[i]->currentPosition() > 0 ? 0 : 4000);
+  }
+}
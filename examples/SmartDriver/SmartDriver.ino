@@ -0,0 +1,52 @@
+// SmartDriver.ino
+//
+// Running two steppers with TMC5160 drivers, which generate the whole speed
+// profile themselves. The drivers are connected to the SPI pins of the Due's
+// SPI header, with their chip selects on pins 10 and 4.
+
+#include <SmartDriverStepper.h>
+
+// Driver registers used to set up the motor current and the chopper
+#define TMC_GCONF      0x00
+#define TMC_IHOLD_IRUN 0x10
+#define TMC_CHOPCONF   0x6C
+
+SmartDriverSPI bus;
+SmartDriverStepper stepper_1(bus, 0);
+SmartDriverStepper stepper_2(bus, 1);
+
+SmartDriverStepper* steppers[] = { &stepper_1, &stepper_2 };
+
+void setup() {
+  Serial.begin(9600);
+  bus.begin();
+
+  for (SmartDriverStepper* stepper : steppers) {
+    // Example values, they have to match the motor and the driver board
+    stepper->writeRegister(TMC_GCONF, 0);
+    stepper->writeRegister(TMC_CHOPCONF, 0x000100C3);
+    stepper->writeRegister(TMC_IHOLD_IRUN, 0x00061F0A);
+
+    stepper->setMaxSpeed(50000);
+    stepper->setAcceleration(100000);
+    stepper->begin();
+  }
+}
+
+void loop() {
+  // Collects the positions read by the previous poll and starts the next one
+  bus.poll();
+
+  for (SmartDriverStepper* stepper : steppers) {
+    if (!stepper->isRunning())
+      stepper->moveTo(stepper->currentPosition() > 0 ? 0 : 200000);
+  }
+
+  static uint32_t last_print = 0;
+  if (millis() - last_print >= 200) {
+    last_print = millis();
+    Serial.print(stepper_1.currentPosition());
+    Serial.print("\t");
+    Serial.println(stepper_2.currentPosition());
+  }
+}
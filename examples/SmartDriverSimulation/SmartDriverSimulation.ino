@@ -0,0 +1,81 @@
+// SmartDriverSimulation.ino
+//
+// Runs a SmartDriverStepper against simulated drivers instead of real
+// TMC5160s, so the sketch works on a bare Due. It moves the motor, stops it
+// in the middle of a move and checks the positions, registers and status
+// flags reported by the simulated ramp generator, printing the result of
+// every check to the serial monitor.
+
+#include <SmartDriverStepper.h>
+
+SmartDriverSimulator bus;
+SmartDriverStepper stepper(bus, 0);
+
+uint8_t failures = 0;
+
+void check(const char* name, bool passed) {
+  Serial.print(passed ? "PASS " : "FAIL ");
+  Serial.println(name);
+  if (!passed)
+    failures++;
+}
+
+// Polls the bus until the move is over, or `timeout` ms passed
+bool waitForStop(uint32_t timeout) {
+  uint32_t start = millis();
+  while (millis() - start < timeout) {
+    bus.poll();
+    if (!stepper.isRunning())
+      return true;
+  }
+  return false;
+}
+
+void setup() {
+  Serial.begin(9600);
+
+  stepper.setMaxSpeed(5000);
+  stepper.setAcceleration(20000);
+  check("begin", stepper.begin());
+
+  // The registers keep the values written by the stepper
+  check("VMAX written", stepper.readRegister(TMC_VMAX) > 0);
+  check("AMAX written", stepper.readRegister(TMC_AMAX) > 0);
+
+  // 0.25 s of acceleration and deceleration and 1.75 s of cruising
+  uint32_t start = millis();
+  stepper.moveTo(10000);
+  check("move finishes", waitForStop(5000));
+  uint32_t duration = millis() - start;
+  check("move takes about 2.25 s", duration > 2100 && duration < 2500);
+  check("move reaches the target", stepper.currentPosition() == 10000);
+  check("XACTUAL at the target", stepper.readRegister(TMC_XACTUAL) == 10000);
+  check("position reached flag",
+        stepper.status() & TMC_STATUS_POSITION_REACHED);
+
+  stepper.moveTo(-200);
+  check("move back finishes", waitForStop(5000));
+  check("move back reaches the target", stepper.currentPosition() == -200);
+
+  // Stop in the middle of a long move, which takes 0.25 s from full speed
+  stepper.moveTo(100000);
+  start = millis();
+  while (millis() - start < 1000)
+    bus.poll();
+  stepper.stop();
+  check("stop finishes", waitForStop(1000));
+  check("stopped at the standstill",
+        stepper.status() & TMC_STATUS_STANDSTILL);
+  check("stopped before the target", stepper.currentPosition() < 100000);
+  check("target is the stop position",
+        stepper.targetPosition() == stepper.currentPosition());
+
+  stepper.setCurrentPosition(0);
+  stepper.move(1);
+  check("single step finishes", waitForStop(1000));
+  check("single step reaches the target", stepper.currentPosition() == 1);
+
+  Serial.println(failures == 0 ? "All checks passed" : "Some checks failed");
+}
+
+void loop() {}
@@ -0,0 +1,32 @@
+// Trajectory.ino
+//
+// Plays back a fixed move whose step intervals are generated at compile time
+// and stored in flash, so no speed profile is computed while the motor runs.
+
+#include <InterruptStepper.h>
+#include <TrajectoryGenerator.h>
+
+#define STEP_PIN 13
+#define DIR_PIN 12
+
+void updateFunc() {}
+
+InterruptStepper stepper(Timer3, updateFunc, InterruptStepper::DRIVER, STEP_PIN, DIR_PIN);
+
+// A move of 3200 steps accelerating at 20000 steps/s^2 up to 8000 steps/s
+typedef TrajectoryGenerator<3200, 8000, 20000> Move;
+
+void setup() {
+  stepper.attachInterrupt([](){ stepper.stepInterrupt(); });
+}
+
+void loop() {
+  // Move forward, then retrace the move backwards
+  stepper.playTrajectory(Move::trajectory);
+  while (stepper.isPlaying()) {}
+  delay(500);
+
+  stepper.playTrajectory(Move::trajectory, true);
+  while (stepper.isPlaying()) {}
+  delay(500);
+}
@@ -280,6 +280,7 @@
 
 // These defs cause trouble on some versions of Arduino
 #undef round
+#include "../InterruptStepperConfig.h"
 
 // Use the system yield() whenever possoible, since some platforms require it for housekeeping, especially
 // ESP8266
@@ -575,36 +576,36 @@ protected:
     /// \li  after change to target position (relative or absolute) through
     /// move() or moveTo()
     /// \return the new step interval
-    virtual unsigned long  computeNewSpeed();
+    INTERRUPT_STEPPER_RAMFUNC virtual unsigned long  computeNewSpeed();
 
     /// Low level function to set the motor output pins
     /// bit 0 of the mask corresponds to _pin[0]
     /// bit 1 of the mask corresponds to _pin[1]
     /// You can override this to impment, for example serial chip output insted of using the
     /// output pins directly
-    virtual void   setOutputPins(uint8_t mask);
+    INTERRUPT_STEPPER_RAMFUNC virtual void   setOutputPins(uint8_t mask);
 
     /// Called to execute a step. Only called when a new step is
     /// required. Subclasses may override to implement new stepping
     /// interfaces. The default calls step1(), step2(), step4() or step8() depending on the
     /// number of pins defined for the stepper.
     /// \param[in] step The current step phase number (0 to 7)
-    virtual void   step(long step);
+    INTERRUPT_STEPPER_RAMFUNC virtual void   step(long step);
     
     /// Called to execute a clockwise(+) step. Only called when a new step is
     /// required. This increments the _currentPos and calls step()
     /// \return the updated current position
-    long   stepForward();
+    INTERRUPT_STEPPER_RAMFUNC long   stepForward();
 
     /// Called to execute a counter-clockwise(-) step. Only called when a new step is
     /// required. This decrements the _currentPos and calls step()
     /// \return the updated current position
-    long   stepBackward();
+    INTERRUPT_STEPPER_RAMFUNC long   stepBackward();
 
     /// Called to execute a step using stepper functions (pins = 0) Only called when a new step is
     /// required. Calls _forward() or _backward() to perform the step
     /// \param[in] step The current step phase number (0 to 7)
-    virtual void   step0(long step);
+    INTERRUPT_STEPPER_RAMFUNC virtual void   step0(long step);
 
     /// Called to execute a step on a stepper driver (ie where pins == 1). Only called when a new step is
     /// required. Subclasses may override to implement new stepping
@@ -612,41 +613,41 @@ protected:
     /// and sets the output of _pin2 to the desired direction. The Step pin (_pin1) is pulsed for 1 microsecond
     /// which is the minimum STEP pulse width for the 3967 driver.
     /// \param[in] step The current step phase number (0 to 7)
-    virtual void   step1(long step);
+    INTERRUPT_STEPPER_RAMFUNC virtual void   step1(long step);
 
     /// Called to execute a step on a 2 pin motor. Only called when a new step is
     /// required. Subclasses may override to implement new stepping
     /// interfaces. The default sets or clears the outputs of pin1 and pin2
     /// \param[in] step The current step phase number (0 to 7)
-    virtual void   step2(long step);
+    INTERRUPT_STEPPER_RAMFUNC virtual void   step2(long step);
 
     /// Called to execute a step on a 3 pin motor, such as HDD spindle. Only called when a new step is
     /// required. Subclasses may override to implement new stepping
     /// interfaces. The default sets or clears the outputs of pin1, pin2,
     /// pin3
     /// \param[in] step The current step phase number (0 to 7)
-    virtual void   step3(long step);
+    INTERRUPT_STEPPER_RAMFUNC virtual void   step3(long step);
 
     /// Called to execute a step on a 4 pin motor. Only called when a new step is
     /// required. Subclasses may override to implement new stepping
     /// interfaces. The default sets or clears the outputs of pin1, pin2,
     /// pin3, pin4.
     /// \param[in] step The current step phase number (0 to 7)
-    virtual void   step4(long step);
+    INTERRUPT_STEPPER_RAMFUNC virtual void   step4(long step);
 
     /// Called to execute a step on a 3 pin motor, such as HDD spindle. Only called when a new step is
     /// required. Subclasses may override to implement new stepping
     /// interfaces. The default sets or clears the outputs of pin1, pin2,
     /// pin3
     /// \param[in] step The current step phase number (0 to 7)
-    virtual void   step6(long step);
+    INTERRUPT_STEPPER_RAMFUNC virtual void   step6(long step);
 
     /// Called to execute a step on a 4 pin half-stepper motor. Only called when a new step is
     /// required. Subclasses may override to implement new stepping
     /// interfaces. The default sets or clears the outputs of pin1, pin2,
     /// pin3, pin4.
     /// \param[in] step The current step phase number (0 to 7)
-    virtual void   step8(long step);
+    INTERRUPT_STEPPER_RAMFUNC virtual void   step8(long step);
 
     /// Current direction motor is spinning in
     /// Protected because some peoples subclasses need it to be so
@@ -0,0 +1,284 @@
+/*
+  ArcInterpolator.cpp - Moves two InterruptSteppers along a circular arc,
+  stepping the arc from a timer interrupt.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "ArcInterpolator.h"
+
+// Allowed error of the estimated number of steps along the arc (at most a
+// quarter of them). The arc ends once it is this close to the estimate and
+// next to the end point.
+#define ARC_COUNT_SLACK 12
+// Ratio of the length of a diagonal step to an axial one (√2 * 128)
+#define ARC_DIAGONAL_128 181
+// Minimal period (in μs) of the timer
+#define ARC_MIN_PERIOD 5
+
+static inline int8_t sign(long value) {
+  return (value > 0) - (value < 0);
+}
+
+ArcInterpolator::ArcInterpolator(PrecDueTimer& timer, InterruptStepper& x, 
+                                 InterruptStepper& y)
+  : _timer(timer), _stepper_x(x), _stepper_y(y) {}
+
+void ArcInterpolator::attachInterrupt(void (*isr)()) {
+  _timer.attachInterrupt(isr);
+}
+
+bool ArcInterpolator::arcTo(long x, long y, long center_x, long center_y, 
+                            bool clockwise, float speed, float acceleration) {
+  if (_running || speed <= 0.0 || acceleration <= 0.0)
+    return false;
+  InterruptStepper* steppers[] = { &_stepper_x, &_stepper_y };
+  for (InterruptStepper* s : steppers) {
+    if (s->isRunning() || s->_engine != NULL || s->_velocity_mode 
+        || InterruptStepper::emergencyStopped())
+      return false;
+  }
+
+  _x = _stepper_x.currentPosition() - center_x;
+  _y = _stepper_y.currentPosition() - center_y;
+  if (_x == 0 && _y == 0)
+    return false;
+  _end_x = x - center_x;
+  _end_y = y - center_y;
+  _error = 0;
+  _clockwise = clockwise;
+
+  // Estimate the number of steps: in every octant each step moves the
+  // faster axis by one, so add up its distance between the octant borders
+  float radius = sqrt((float)_x * _x + (float)_y * _y);
+  float start = atan2(_y, _x);
+  float end = atan2(_end_y, _end_x);
+  float sweep = clockwise ? start - end : end - start;
+  while (sweep <= 0.0)
+    sweep += 2 * PI;
+  float total = 0.0;
+  float angle = start;
+  float direction = clockwise ? -1.0 : 1.0;
+  while (sweep > 0.0) {
+    // Distance to the next multiple of 45° in the direction of the arc
+    float octant = PI / 4;
+    float position = angle / octant;
+    float border = clockwise ? ceil(position) - 1 : floor(position) + 1;
+    float span = fabs(border * octant - angle);
+    if (span < 1e-6)
+      span = octant;
+    if (span > sweep)
+      span = sweep;
+    float next = angle + direction * span;
+    float dx = fabs(radius * (cos(next) - cos(angle)));
+    float dy = fabs(radius * (sin(next) - sin(angle)));
+    total += dx > dy ? dx : dy;
+    angle = next;
+    sweep -= span;
+  }
+  _count = 0;
+  _total = total + 0.5;
+  _on_arc = true;
+  _stopping = false;
+  _estop_stopping = false;
+
+  _profile.cmin = 1000000.0 / speed;
+  _profile.c0 = 0.676 * sqrt(2.0 / acceleration) * 1000000.0;
+  _profile.setStepsToMaxSpeed(speed * speed / (2.0 * acceleration));
+  _profile.n = 0;
+
+  noInterrupts();
+  // The steppers report the end of the arc as their target while it runs
+  _stepper_x._targetPos = x;
+  _stepper_y._targetPos = y;
+  _running = true;
+  interrupts();
+  _timer.start(ARC_MIN_PERIOD);
+  return true;
+}
+
+bool ArcInterpolator::isRunning() {
+  return _running;
+}
+
+void ArcInterpolator::stop() {
+  noInterrupts();
+  if (_running) {
+    _stopping = true;
+    _total = _count + _profile.stepsToStop();
+  }
+  interrupts();
+}
+
+void ArcInterpolator::stepInterrupt() {
+  uint32_t start = micros();
+  if (!_running) {
+    _timer.stop();
+    return;
+  }
+  if (InterruptStepper::emergencyStopped() && !_estop_stopping 
+      && !emergencyDecelerate()) {
+    _stepper_x.dropDeferredStep();
+    _stepper_y.dropDeferredStep();
+    finish();
+    return;
+  }
+
+  // Steps delayed by a change of direction, and the takeup pulses of the
+  // backlash before them, are made before the arc goes on
+  if (_stepper_x._step_deferred || _stepper_y._step_deferred) {
+    uint32_t wait = 0;
+    if (_stepper_x._step_deferred)
+      wait = _stepper_x.deferredPulse();
+    if (_stepper_y._step_deferred) {
+      uint32_t wait_y = _stepper_y.deferredPulse();
+      if (wait_y > wait)
+        wait = wait_y;
+    }
+    if (wait == 0)
+      wait = _deferred_interval;
+    _timer.start(wait > ARC_MIN_PERIOD ? wait : ARC_MIN_PERIOD);
+    return;
+  }
+
+  int8_t dx, dy;
+  nextStep(dx, dy);
+  if (dx == 0 && dy == 0) {
+    finish();
+    return;
+  }
+
+  if (dx != 0)
+    _stepper_x.arcStep(dx > 0);
+  if (dy != 0)
+    _stepper_y.arcStep(dy > 0);
+
+  uint32_t interval = nextInterval();
+  if (dx != 0 && dy != 0)
+    interval = interval * ARC_DIAGONAL_128 / 128;
+  // The load governor and the feed override apply to the arc like to the
+  // moves of single steppers
+  interval = InterruptStepper::scaleInterval(interval, start);
+  uint32_t elapsed = micros() - start;
+  interval = interval > elapsed + ARC_MIN_PERIOD ? interval - elapsed 
+                                                 : ARC_MIN_PERIOD;
+
+  // A change of direction delays the step by the direction setup time, and
+  // the rest of the arc by the deferred pulses
+  if (_stepper_x._step_deferred || _stepper_y._step_deferred) {
+    _deferred_interval = interval;
+    uint32_t setup = _stepper_x._dir_setup > _stepper_y._dir_setup 
+                     ? _stepper_x._dir_setup : _stepper_y._dir_setup;
+    interval = setup > ARC_MIN_PERIOD ? setup : ARC_MIN_PERIOD;
+  }
+  _timer.start(interval);
+}
+
+void ArcInterpolator::nextStep(int8_t& dx, int8_t& dy) {
+  dx = 0;
+  dy = 0;
+  if (_stopping && _count >= _total)
+    return;
+
+  if (!_on_arc) {
+    // Straight to the end point, which can be a little off the circle
+    dx = sign(_end_x - _x);
+    dy = sign(_end_y - _y);
+    _x += dx;
+    _y += dy;
+    _count++;
+    return;
+  }
+
+  // Direction of the motion along the circle: the tangent (-y, x) turned
+  // by 180° when going clockwise
+  int8_t tx = _clockwise ? sign(_y) : -sign(_y);
+  int8_t ty = _clockwise ? -sign(_x) : sign(_x);
+  if (labs(_x) >= labs(_y)) {
+    // Near the X axis the motion is mostly along Y. Step Y and also X if
+    // that keeps the position closer to the circle.
+    dy = ty;
+    long error = _error + 2 * _y * dy + 1;
+    long diagonal = error + 2 * _x * tx + 1;
+    if (tx != 0 && labs(diagonal) < labs(error)) {
+      dx = tx;
+      error = diagonal;
+    }
+    _error = error;
+  } else {
+    dx = tx;
+    long error = _error + 2 * _x * dx + 1;
+    long diagonal = error + 2 * _y * ty + 1;
+    if (ty != 0 && labs(diagonal) < labs(error)) {
+      dy = ty;
+      error = diagonal;
+    }
+    _error = error;
+  }
+  _x += dx;
+  _y += dy;
+  _count++;
+
+  // The estimate of the steps tells the end of a full circle apart from its
+  // start, the end point tells when the arc is over
+  long slack = _total / 4 < ARC_COUNT_SLACK ? _total / 4 : ARC_COUNT_SLACK;
+  bool near_end = labs(_end_x - _x) <= 1 && labs(_end_y - _y) <= 1;
+  if ((near_end && _count + slack >= _total) 
+      || _count >= _total + ARC_COUNT_SLACK)
+    _on_arc = false;
+}
+
+long ArcInterpolator::remainingSteps() {
+  long remaining = _total - _count;
+  if (!_on_arc || _stopping) {
+    long distance_x = labs(_end_x - _x);
+    long distance_y = labs(_end_y - _y);
+    long straight = distance_x > distance_y ? distance_x : distance_y;
+    remaining = _stopping ? remaining : straight;
+  }
+  return remaining > 0 ? remaining : 0;
+}
+
+uint32_t ArcInterpolator::nextInterval() {
+  if (_profile.n > 0 && _profile.stepsToStop() >= remainingSteps())
+    _profile.n = -_profile.n;
+  return _profile.nextInterval();
+}
+
+bool ArcInterpolator::emergencyDecelerate() {
+  // The steppers are halted by the emergency stop with `EMERGENCY_HALT` or
+  // without an emergency deceleration. Before the first step there is no
+  // speed to decelerate from.
+  if (_stepper_x._estop_state == InterruptStepper::ESTOP_HALT 
+      || _stepper_y._estop_state == InterruptStepper::ESTOP_HALT || _count == 0)
+    return false;
+
+  float deceleration = _stepper_x._estop_deceleration;
+  if (_stepper_y._estop_deceleration < deceleration)
+    deceleration = _stepper_y._estop_deceleration;
+  float speed = 1000000.0 / _profile.cn;
+  long steps_to_stop = (long)(speed * speed / (2.0 * deceleration)); // Equation 16
+  _profile.n = -steps_to_stop;
+  _stopping = true;
+  _total = _count + steps_to_stop;
+  _estop_stopping = true;
+
+  // The steppers count as decelerating, so the emergency stop can't be
+  // reset before the arc is over
+  InterruptStepper* steppers[] = { &_stepper_x, &_stepper_y };
+  for (InterruptStepper* s : steppers) {
+    s->_estop_saved_accel = s->_acceleration;
+    s->_estop_state = InterruptStepper::ESTOP_DECELERATING;
+  }
+  return true;
+}
+
+void ArcInterpolator::finish() {
+  _timer.stop();
+  _stepper_x._targetPos = _stepper_x._currentPos;
+  _stepper_y._targetPos = _stepper_y._currentPos;
+  _running = false;
+}
@@ -0,0 +1,108 @@
+/*
+  ArcInterpolator.h - Moves two InterruptSteppers along a circular arc,
+  stepping the arc from a timer interrupt.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef ARC_INTERPOLATOR_H
+#define ARC_INTERPOLATOR_H
+
+#include "InterruptStepper.h"
+#include "StepProfile.h"
+
+// Steps two steppers (the X and Y axes) along a circle with the midpoint
+// circle algorithm. Every interrupt makes one step along the arc: a step of
+// the axis that moves faster in the current octant, together with a step of
+// the other axis if that keeps the position closer to the circle. Only
+// integer additions and comparisons are needed per step. The speed along
+// the arc follows the same accelerated profile as a single stepper, so a
+// whole arc is a single move instead of many short straight segments.
+//
+// The steppers are stepped directly by the interpolator's timer, so they
+// must not be attached to a step engine, and must be stationary (and not in
+// the velocity mode) when an arc starts.
+class ArcInterpolator {
+public:
+  // Takes a timer that isn't used by anything else and the steppers of the
+  // X and Y axes.
+  ArcInterpolator(PrecDueTimer& timer, InterruptStepper& x, InterruptStepper& y);
+
+  // Attaches the interrupt function that must call `stepInterrupt()`:
+  // arc.attachInterrupt([](){ arc.stepInterrupt(); });
+  void attachInterrupt(void (*isr)());
+
+  // Starts an arc from the current position to the absolute position
+  // (`x`, `y`) around the center (`center_x`, `center_y`). The radius is
+  // the distance of the current position from the center. An end equal to
+  // the current position makes a full circle. `speed` (steps/s) and
+  // `acceleration` (steps/s^2) apply along the arc. Returns false if an arc
+  // is already running, a stepper is running or can't be stepped by the
+  // interpolator, or the current position is the center.
+  bool arcTo(long x, long y, long center_x, long center_y, bool clockwise,
+             float speed, float acceleration);
+
+  // Returns true while an arc is running.
+  bool isRunning();
+
+  // Decelerates to a stop on the arc as quickly as the acceleration allows.
+  // An emergency stop halts the arc, or with `EMERGENCY_DECELERATE`
+  // decelerates it on the arc at the lower emergency deceleration of the
+  // two steppers.
+  void stop();
+
+  // Makes the next step along the arc. Must be called from the timer's
+  // interrupt.
+  INTERRUPT_STEPPER_RAMFUNC void stepInterrupt();
+
+private:
+  // Chooses the steps of the axes along the arc, or straight towards the
+  // end point once the arc is finished
+  INTERRUPT_STEPPER_RAMFUNC void nextStep(int8_t& dx, int8_t& dy);
+  // Computes the interval (in μs) until the next step along the arc
+  INTERRUPT_STEPPER_RAMFUNC uint32_t nextInterval();
+  // Returns the number of steps left until the end point
+  INTERRUPT_STEPPER_RAMFUNC long remainingSteps();
+  // Ends the arc
+  INTERRUPT_STEPPER_RAMFUNC void finish();
+  // Starts decelerating on the arc after an emergency stop with
+  // `EMERGENCY_DECELERATE`. Returns false if the arc must halt instead.
+  INTERRUPT_STEPPER_RAMFUNC bool emergencyDecelerate();
+
+  PrecDueTimer& _timer;
+  InterruptStepper& _stepper_x;
+  InterruptStepper& _stepper_y;
+
+  // Position relative to the center and the end point
+  long _x;
+  long _y;
+  long _end_x;
+  long _end_y;
+  // x^2 + y^2 - r^2 at the current position
+  long _error;
+  bool _clockwise;
+  // Whether the steps still follow the circle, and not the final straight
+  // steps to the end point
+  bool _on_arc;
+  // Steps made since the start (along the arc and then straight to the end
+  // point) and the estimated number of the steps along the arc, or of all
+  // of them once stopping
+  long _count;
+  long _total;
+  // Whether `stop()` was called, so that the arc ends where the motors stop
+  bool _stopping;
+  // Whether the arc decelerates after an emergency stop
+  bool _estop_stopping;
+  volatile bool _running = false;
+  // Interval (in μs) to the next step along the arc once the steps delayed
+  // by a change of direction are made
+  uint32_t _deferred_interval;
+
+  // Speed profile along the arc, as in AccelStepper but in μs
+  StepProfile _profile;
+};
+
+#endif
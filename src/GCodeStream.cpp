@@ -0,0 +1,190 @@
+/*
+  GCodeStream.cpp - Streams G0/G1 G-code moves from a serial port into a
+  StepperGroup.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "GCodeStream.h"
+
+// Number of significant digits kept in a parsed number
+#define MAX_DIGITS 9
+
+GCodeStream::GCodeStream(Stream& stream, StepperGroup& group)
+  : _stream(stream), _group(group) {
+  for (uint8_t i = 0; i < STEPPER_GROUP_MAX_STEPPERS; i++) {
+    _letters[i] = 0;
+    _steps_per_unit[i] = 1.0;
+    _position[i] = 0.0;
+  }
+}
+
+void GCodeStream::setAxis(uint8_t index, char letter, float steps_per_unit) {
+  if (index >= STEPPER_GROUP_MAX_STEPPERS)
+    return;
+  _letters[index] = toupper(letter);
+  _steps_per_unit[index] = steps_per_unit;
+}
+
+void GCodeStream::setRapidFeedRate(float feed_rate) {
+  _rapid_feed_rate = fabs(feed_rate);
+}
+
+void GCodeStream::setAcceleration(float acceleration) {
+  _acceleration = fabs(acceleration);
+}
+
+void GCodeStream::poll() {
+  while (_stream.available() > 0) {
+    // Leave the next line in the receive buffer until it can be queued
+    if (!_line_started && _group.queueSpace() == 0)
+      return;
+
+    char c = _stream.read();
+    _line_started = true;
+
+    if (c == '\n') {
+      endWord();
+      endLine();
+      continue;
+    }
+    if (_comment || c == '\r')
+      continue;
+    if (_paren_comment) {
+      _paren_comment = c != ')';
+      continue;
+    }
+
+    if (isalpha(c)) {
+      endWord();
+      _letter = toupper(c);
+      _negative = false;
+      _fraction = false;
+      _mantissa = 0;
+      _exponent = 0;
+      _digits = 0;
+    } else if (isdigit(c)) {
+      if (_digits < MAX_DIGITS) {
+        _mantissa = _mantissa * 10 + (c - '0');
+        if (_mantissa != 0)
+          _digits++;
+        if (_fraction)
+          _exponent--;
+      } else if (!_fraction) {
+        _exponent++;
+      }
+    } else if (c == '-') {
+      _negative = true;
+    } else if (c == '.') {
+      _fraction = true;
+    } else if (c == ';') {
+      endWord();
+      _comment = true;
+    } else if (c == '(') {
+      endWord();
+      _paren_comment = true;
+    }
+  }
+}
+
+uint32_t GCodeStream::linesProcessed() {
+  return _lines;
+}
+
+void GCodeStream::endWord() {
+  if (_letter == 0)
+    return;
+
+  float value = _mantissa;
+  for (int8_t i = _exponent; i < 0; i++)
+    value /= 10.0;
+  for (int8_t i = 0; i < _exponent; i++)
+    value *= 10.0;
+  if (_negative)
+    value = -value;
+
+  if (_letter == 'G') {
+    switch ((int)value) {
+      case 0: _rapid = true; _linear = true; _motion = true; break;
+      case 1: _rapid = false; _linear = true; _motion = true; break;
+      case 2: case 3: case 38: case 80: _linear = false; break;
+      case 4: case 10: case 28: case 30: case 92: _skip_axes = true; break;
+      case 90: _absolute = true; break;
+      case 91: _absolute = false; break;
+    }
+  } else if (_letter == 'F') {
+    if (value > 0.0)
+      _feed_rate = value;
+  } else {
+    for (uint8_t i = 0; i < axisCount(); i++) {
+      if (_letters[i] == _letter) {
+        _values[i] = value;
+        _axes |= 1 << i;
+        _motion = true;
+        break;
+      }
+    }
+  }
+  _letter = 0;
+}
+
+void GCodeStream::setKinematics(Kinematics& kinematics) {
+  _kinematics = &kinematics;
+}
+
+uint8_t GCodeStream::axisCount() {
+  return _kinematics != NULL ? _kinematics->axes() : _group.size();
+}
+
+void GCodeStream::endLine() {
+  if (_axes != 0 && _motion && _linear && !_skip_axes) {
+    long targets[STEPPER_GROUP_MAX_STEPPERS];
+    float length = 0.0;
+    float step_length = 0.0;
+    float longest = 0.0;
+
+    for (uint8_t i = 0; i < axisCount(); i++) {
+      float position = _position[i];
+      if (_axes & (1 << i))
+        position = _absolute ? _values[i] : position + _values[i];
+
+      float distance = position - _position[i];
+      length += distance * distance;
+      float steps = fabs(distance * _steps_per_unit[i]);
+      step_length += steps * steps;
+      if (steps > longest)
+        longest = steps;
+
+      _position[i] = position;
+      targets[i] = lroundf(position * _steps_per_unit[i]);
+    }
+    length = sqrt(length);
+    step_length = sqrt(step_length);
+
+    if (length > 0.0) {
+      float feed_rate = (_rapid ? _rapid_feed_rate : _feed_rate) / 60.0;
+      if (_kinematics != NULL) {
+        // The kinematics takes the speed and acceleration along the path
+        _kinematics->queueMove(targets, feed_rate * step_length / length, 
+                               _acceleration * step_length / length);
+      } else {
+        // Convert the feed rate and acceleration along the path into the
+        // speed and acceleration of the stepper with the longest distance
+        _group.queueMove(targets, feed_rate * longest / length, 
+                         _acceleration * longest / length);
+      }
+    }
+  }
+
+  _axes = 0;
+  _motion = false;
+  _skip_axes = false;
+  _comment = false;
+  _paren_comment = false;
+  _line_started = false;
+  _lines++;
+  _stream.print("ok\n");
+}
@@ -0,0 +1,104 @@
+/*
+  GCodeStream.h - Streams G0/G1 G-code moves from a serial port into a
+  StepperGroup.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef GCODE_STREAM_H
+#define GCODE_STREAM_H
+
+#include "StepperGroup.h"
+#include "Kinematics.h"
+
+class GCodeStream {
+public:
+  // The constructor takes the stream the G-code is read from (e.g. `Serial`)
+  // and the group of steppers that will execute the moves.
+  GCodeStream(Stream& stream, StepperGroup& group);
+
+  // Assigns the G-code axis `letter` (e.g. 'X') to the stepper with the given
+  // `index` in the group. `steps_per_unit` converts G-code units (e.g. mm)
+  // into steps.
+  void setAxis(uint8_t index, char letter, float steps_per_unit);
+
+  // Makes the axes Cartesian axes of the kinematics instead of the steppers
+  // of the group. `setAxis()` then assigns the letters to the axes of the
+  // kinematics, which must use the same number of steps per unit.
+  void setKinematics(Kinematics& kinematics);
+
+  // Sets the feed rate (in units/min) used by the G0 rapid moves.
+  void setRapidFeedRate(float feed_rate);
+
+  // Sets the acceleration (in units/s^2) along the path of the moves.
+  void setAcceleration(float acceleration);
+
+  // Parses the bytes waiting in the stream. The bytes are parsed one by one
+  // as they are read, without copying the lines into a buffer. A new line is
+  // only read when the group has room for another move, so the remaining
+  // lines wait in the serial receive buffer. "ok" is sent back after every
+  // line, so the sender knows when it can send the next one. Should be called
+  // as often as possible from the main loop.
+  void poll();
+
+  // Returns the number of lines processed so far.
+  uint32_t linesProcessed();
+
+private:
+  // Finishes parsing the current word (letter and number)
+  void endWord();
+  // Executes the parsed line
+  void endLine();
+  // Returns the number of axes
+  uint8_t axisCount();
+
+  Stream& _stream;
+  StepperGroup& _group;
+  // Kinematics of the axes (NULL if every axis is a stepper of the group)
+  Kinematics* _kinematics = NULL;
+
+  // Axis letter and steps per unit of every axis
+  char _letters[STEPPER_GROUP_MAX_STEPPERS];
+  float _steps_per_unit[STEPPER_GROUP_MAX_STEPPERS];
+  // Last commanded position (in units) of every axis
+  float _position[STEPPER_GROUP_MAX_STEPPERS];
+
+  // Modal state
+  bool _absolute = true;
+  bool _rapid = true;
+  // Whether the motion mode is G0 or G1. The axis words of the other modes
+  // (the arcs of G2 and G3, probing with G38, G80) don't make any move.
+  bool _linear = true;
+  float _feed_rate = 600.0;
+  float _rapid_feed_rate = 3000.0;
+  float _acceleration = 1000.0;
+
+  // State of the line being parsed
+  bool _line_started = false;
+  bool _comment = false;
+  bool _paren_comment = false;
+  // Axis values of the line and the bit mask of the axes present in it
+  float _values[STEPPER_GROUP_MAX_STEPPERS];
+  uint8_t _axes = 0;
+  // Whether the line contains a motion command or a feed rate
+  bool _motion = false;
+  // Whether a G code of the line uses its axis words for something else than
+  // a move (G4, G10, G28, G30, G92), so that they are ignored
+  bool _skip_axes = false;
+
+  // State of the word being parsed
+  char _letter = 0;
+  bool _negative;
+  bool _fraction;
+  // The number of the word is mantissa * 10^exponent
+  long _mantissa;
+  int8_t _exponent;
+  uint8_t _digits;
+
+  uint32_t _lines = 0;
+};
+
+#endif
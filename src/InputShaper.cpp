@@ -0,0 +1,122 @@
+/*
+  InputShaper.cpp - Shapes the velocity commanded by the velocity loop with an
+  impulse train that cancels a resonance of the machine.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "InputShaper.h"
+
+InputShaper::InputShaper(Type type, float frequency, float damping) {
+  setShaper(type, frequency, damping);
+}
+
+void InputShaper::setShaper(Type type, float frequency, float damping) {
+  if (damping < 0.0)
+    damping = 0.0;
+  if (damping > 0.9)
+    damping = 0.9;
+  float root = sqrt(1.0 - damping * damping);
+  // Damped period of the resonance
+  float period = 1.0 / (frequency * root);
+  float k = exp(-damping * PI / root);
+
+  switch (type) {
+    case ZV:
+      _impulses = 2;
+      _amplitude[0] = 1.0;
+      _amplitude[1] = k;
+      _time[0] = 0.0;
+      _time[1] = 0.5 * period;
+      break;
+    case ZVD:
+      _impulses = 3;
+      _amplitude[0] = 1.0;
+      _amplitude[1] = 2.0 * k;
+      _amplitude[2] = k * k;
+      _time[0] = 0.0;
+      _time[1] = 0.5 * period;
+      _time[2] = period;
+      break;
+    case MZV:
+    default:
+      k = exp(-0.75 * damping * PI / root);
+      _impulses = 3;
+      _amplitude[0] = 1.0 - 1.0 / sqrt(2.0);
+      _amplitude[1] = (sqrt(2.0) - 1.0) * k;
+      _amplitude[2] = _amplitude[0] * k * k;
+      _time[0] = 0.0;
+      _time[1] = 0.375 * period;
+      _time[2] = 0.75 * period;
+      break;
+  }
+
+  float sum = 0.0;
+  for (uint8_t i = 0; i < _impulses; i++)
+    sum += _amplitude[i];
+  for (uint8_t i = 0; i < _impulses; i++)
+    _amplitude[i] /= sum;
+
+  reset();
+}
+
+float InputShaper::duration() {
+  return _time[_impulses - 1];
+}
+
+uint8_t InputShaper::impulses() {
+  return _impulses;
+}
+
+float InputShaper::impulseTime(uint8_t i) {
+  return i < _impulses ? _time[i] : 0.0;
+}
+
+float InputShaper::impulseAmplitude(uint8_t i) {
+  return i < _impulses ? _amplitude[i] : 0.0;
+}
+
+void InputShaper::reset() {
+  for (uint16_t i = 0; i < INPUT_SHAPER_MAX_SAMPLES; i++)
+    _history[i] = 0.0;
+  _index = 0;
+  _zeros = INPUT_SHAPER_MAX_SAMPLES;
+}
+
+bool InputShaper::idle() {
+  // The samples older than the last impulse don't count anymore
+  return _zeros >= INPUT_SHAPER_MAX_SAMPLES || _zeros > duration() / _dt + 1;
+}
+
+float InputShaper::shape(float v, float dt) {
+  _dt = dt;
+  _index = (_index + 1) % INPUT_SHAPER_MAX_SAMPLES;
+  _history[_index] = v;
+  if (v != 0.0)
+    _zeros = 0;
+  else if (_zeros < INPUT_SHAPER_MAX_SAMPLES)
+    _zeros++;
+  if (idle())
+    return 0.0;
+
+  float shaped = 0.0;
+  for (uint8_t i = 0; i < _impulses; i++)
+    shaped += _amplitude[i] * sample(_time[i] / dt);
+  return shaped;
+}
+
+float InputShaper::sample(float delay) {
+  // Longer delays than the history are cut short
+  if (delay > INPUT_SHAPER_MAX_SAMPLES - 2)
+    delay = INPUT_SHAPER_MAX_SAMPLES - 2;
+  uint16_t whole = delay;
+  float fraction = delay - whole;
+  float newer = _history[(_index + INPUT_SHAPER_MAX_SAMPLES - whole) 
+                         % INPUT_SHAPER_MAX_SAMPLES];
+  float older = _history[(_index + INPUT_SHAPER_MAX_SAMPLES - whole - 1) 
+                         % INPUT_SHAPER_MAX_SAMPLES];
+  return newer + (older - newer) * fraction;
+}
@@ -0,0 +1,79 @@
+/*
+  InputShaper.h - Shapes the velocity commanded by the velocity loop with an
+  impulse train that cancels a resonance of the machine.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef INPUT_SHAPER_H
+#define INPUT_SHAPER_H
+
+#include <Arduino.h>
+
+// Number of past velocity samples kept, which limits the duration of the
+// shaper to this many periods of the velocity loop
+#define INPUT_SHAPER_MAX_SAMPLES 256
+// Maximum number of impulses of a shaper
+#define INPUT_SHAPER_MAX_IMPULSES 3
+
+// The commanded velocity is convolved with a few impulses spread over a
+// period of the resonance, so that the vibrations excited by each impulse
+// cancel each other out. The sum of the impulses is 1, so the shaped
+// motion ends at the same position, just later by the duration of the
+// shaper. Every stepper needs its own shaper, which keeps the history of
+// its velocity.
+class InputShaper {
+public:
+  enum Type {
+    ZV,  // Zero vibration: 2 impulses over half a period
+    ZVD, // Zero vibration and derivative: 3 impulses over a whole period,
+         // less sensitive to an error of the frequency
+    MZV  // Modified ZV: 3 impulses over 3/4 of a period, between the two
+  };
+
+  // `frequency` is the frequency (in Hz) of the resonance to cancel and
+  // `damping` its damping ratio.
+  InputShaper(Type type, float frequency, float damping = 0.1);
+
+  // Changes the shaper. Also clears the history.
+  void setShaper(Type type, float frequency, float damping = 0.1);
+
+  // Returns the time (in s) by which the shaped motion lags behind.
+  float duration();
+  // Returns the number of impulses and the time (in s) and amplitude of
+  // each of them.
+  uint8_t impulses();
+  float impulseTime(uint8_t i);
+  float impulseAmplitude(uint8_t i);
+
+  // Clears the history, as if the velocity was 0 for a long time.
+  void reset();
+  // Returns true if the velocity was 0 for the whole duration of the
+  // shaper, so that the shaped velocity is 0 too.
+  bool idle();
+
+  // Adds the velocity `v` sampled `dt` seconds after the previous one to
+  // the history and returns the shaped velocity.
+  float shape(float v, float dt);
+
+private:
+  // Returns the velocity `delay` samples ago, interpolated between samples
+  float sample(float delay);
+
+  uint8_t _impulses;
+  float _time[INPUT_SHAPER_MAX_IMPULSES];
+  float _amplitude[INPUT_SHAPER_MAX_IMPULSES];
+
+  float _history[INPUT_SHAPER_MAX_SAMPLES];
+  // Index of the newest sample
+  uint16_t _index;
+  // Number of zero samples added since the last non-zero one
+  uint16_t _zeros;
+  // Period of the samples (in s)
+  float _dt = 0.001;
+};
+
+#endif
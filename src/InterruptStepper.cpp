@@ -9,6 +9,8 @@
 */
 
 #include "InterruptStepper.h"
+#include "StepperGroup.h"
+#include "StepEngine.h"
 
 // Time it takes (in μs) for the `DueTimer::Timer` to actually start counting time
 #define TIMER_SETUP_TIME 8
@@ -16,6 +18,41 @@
 #define MIN_PERIOD_TIME 5
 // Maximum period time (in μs) that the `DueTimer::Timer` can support
 #define MAX_PERIOD_TIME 102261126
+// Largest factor by which the load governor changes the speed in one window
+#define LOAD_SCALE_STEP 1.25
+// Lowest speed (as a fraction of the full speed) set by the load governor
+#define LOAD_SCALE_MIN_SPEED 0.05
+// Limits of the feed override
+#define FEED_OVERRIDE_MIN 0.1
+#define FEED_OVERRIDE_MAX 2.0
+// The rates of the feed override and load governor ramps are given per
+// 2^RAMP_SHIFT μs
+#define RAMP_SHIFT 20
+// Value of `_step_port` when the step pin can't be written by the engine
+#define NO_STEP_PORT 0xff
+
+InterruptStepper* InterruptStepper::_first_stepper = NULL;
+uint8_t InterruptStepper::_estop_pin = 0xff;
+InterruptStepper::EmergencyAction InterruptStepper::_estop_action = EMERGENCY_HALT;
+volatile bool InterruptStepper::_estopped = false;
+volatile uint32_t InterruptStepper::_estop_time = 0;
+float InterruptStepper::_load_budget = 0.0;
+uint32_t InterruptStepper::_load_window = 10000;
+uint32_t InterruptStepper::_load_window_start = 0;
+volatile uint32_t InterruptStepper::_load_busy = 0;
+volatile float InterruptStepper::_load = 0.0;
+volatile uint32_t InterruptStepper::_load_scale = LOAD_SCALE_ONE;
+volatile uint32_t InterruptStepper::_load_from = LOAD_SCALE_ONE;
+volatile uint32_t InterruptStepper::_load_to = LOAD_SCALE_ONE;
+volatile uint32_t InterruptStepper::_load_ramp_start = 0;
+volatile uint32_t InterruptStepper::_load_rate = 0;
+volatile uint32_t InterruptStepper::_feed_from = LOAD_SCALE_ONE;
+volatile uint32_t InterruptStepper::_feed_to = LOAD_SCALE_ONE;
+volatile uint32_t InterruptStepper::_feed_ramp_start = 0;
+volatile uint32_t InterruptStepper::_feed_rate = 0;
+volatile uint32_t InterruptStepper::_feed_scale = LOAD_SCALE_ONE;
+PrecDueTimer* InterruptStepper::_velocity_timer = NULL;
+float InterruptStepper::_velocity_dt = 0.001;
 
 InterruptStepper::InterruptStepper(PrecDueTimer& timer, void (&update_func)(), 
                   uint8_t interface, 
@@ -25,40 +62,186 @@ InterruptStepper::InterruptStepper(PrecDueTimer& timer, void (&update_func)(),
                   uint8_t pin4, 
                   bool enable) 
   : AccelStepper(interface, pin1, pin2, pin3, pin4, enable), 
-    _timer(timer), _update_func(update_func) {}
+    _timer(timer), _update_func(update_func) {
+  _next_stepper = _first_stepper;
+  _first_stepper = this;
+
+  _step_port = NO_STEP_PORT;
+  if (interface == DRIVER) {
+    Pio* ports[] = { PIOA, PIOB, PIOC, PIOD };
+    for (uint8_t i = 0; i < 4; i++) {
+      if (g_APinDescription[pin1].pPort == ports[i])
+        _step_port = i;
+    }
+    _step_pio = g_APinDescription[pin1].pPort;
+    _step_mask = g_APinDescription[pin1].ulPin;
+    _dir_port = g_APinDescription[pin2].pPort;
+    _dir_mask = g_APinDescription[pin2].ulPin;
+  }
+}
 
 InterruptStepper::InterruptStepper(PrecDueTimer &timer, void (&update_func)(), 
                   void (*forward)(), void (*backward)())
   : AccelStepper(forward, backward), 
-    _timer(timer), _update_func(update_func) {}
+    _timer(timer), _update_func(update_func) {
+  _next_stepper = _first_stepper;
+  _first_stepper = this;
+  _step_port = NO_STEP_PORT;
+}
 
 
 void InterruptStepper::stepInterrupt() {
+  if (_step_deferred) {
+    // The previous interrupt changed the direction and started the timer
+    // with the direction setup time, so only the step is made now. The
+    // takeup pulses of the backlash come first. They don't change the
+    // position, and the rest of the move is shifted by their intervals.
+    uint32_t wait = deferredPulse();
+    if (wait > 0) {
+      _next_step_time += wait;
+      start(wait);
+    } else if (_stop_deferred) {
+      _stop_deferred = false;
+      moveFinished();
+    } else {
+      start(_next_step_time - micros());
+    }
+    return;
+  }
+
   // Start measuring time
   _start_time = micros();
   
   //_timer.stop();
 
+  if (_jitter_armed) {
+    int32_t jitter = _start_time - _next_step_time;
+    if ((uint32_t)abs(jitter) > _max_jitter)
+      _max_jitter = abs(jitter);
+    _jitter_armed = false;
+  }
+
+  if (_estop_state != ESTOP_NONE && !emergencyStep())
+    return;
+
   // Step engine forward or backward depending on the stepper's direction
   _direction == DIRECTION_CW ? stepForward() : stepBackward();
 
   _update_func();
-  _next_interval = getNextInterval();
+
+  if (_homing_state == HOMING_FAST || _homing_state == HOMING_SLOW) {
+    if (endstopTriggered()) {
+      homingTriggered();
+      return;
+    }
+  }
+
+  if (_encoder != NULL && ++_enc_steps >= _enc_interval) {
+    if (!checkEncoder()) {
+      halt();
+      return;
+    }
+  }
+
+  if (_trajectory != NULL)
+    _next_interval = nextTrajectoryInterval();
+  else
+    _next_interval = _velocity_mode ? velocityInterval() : getNextInterval();
+
+  // At the coarse resolution a single pulse moves the motor by several fine
+  // microsteps, so account for the remaining ones and add up their intervals
+  if (_ms_coarse) {
+    long step = _direction == DIRECTION_CW ? 1 : -1;
+    uint8_t made = 1;
+    for (; made < _ms_ratio && _next_interval != 0; made++) {
+      _currentPos += step;
+      uint32_t interval = _velocity_mode ? velocityInterval() 
+                                         : getNextInterval();
+      _next_interval = interval ? _next_interval + interval : 0;
+    }
+    // The pulse moved the motor by the whole coarse step even if the move
+    // ended within it, so the position and the target go to its end
+    if (made < _ms_ratio) {
+      _currentPos += step * (_ms_ratio - made);
+      _targetPos = _currentPos;
+    }
+  }
 
   // If the stepper should stop
   if (_next_interval == 0) {
-    _timer.stop();
+    // A step delayed by a change of direction is still made by the timer,
+    // and the move ends after it
+    if (_step_deferred) {
+      _stop_deferred = true;
+      start(_dir_setup);
+      return;
+    }
+    moveFinished();
     return;
   } 
 
+  if (_ms_ratio > 1) {
+    updateMicrostepping();
+  }
+
+  _next_interval = scaleInterval(_next_interval, _start_time);
+  // A feed hold of the group slows down all of its steppers by the same
+  // factor and then parks them, keeping the rest of the move
+  if (_group != NULL) {
+    _group->_intervals[_group_index] = _next_interval;
+    if (_group->_hold_state != StepperGroup::HOLD_NONE) {
+      _next_interval = _group->holdInterval(_next_interval, _start_time);
+      if (_next_interval == 0)
+        return;
+    }
+  }
+
   // Measure how long the stepper's step took
   // Subtract 2μs to compensate for how long measuring time itself took
   _step_time = micros() - _start_time - 2;
 
-  start( _next_interval - _step_time );
+  if (_lateness_policy == LATENESS_CATCH_UP && _move_lateness != 0)
+    catchUp();
+
+  // The engine doesn't restart any timer, so the steps can't be late
+  uint32_t late = _engine == NULL ? checkDeadline() : 0;
+  if (_lateness_policy == LATENESS_FAULT && _move_lateness > _lateness_threshold) {
+    _lateness_fault = true;
+    halt();
+    return;
+  }
+
+  // Step interrupts with different priorities can preempt each other, so
+  // the shared load counters are updated with interrupts disabled
+  __disable_irq();
+  _load_busy += _step_time;
+  if (_start_time - _load_window_start >= _load_window)
+    updateLoadGovernor(_start_time);
+  __enable_irq();
+
+  // The engine's phase accumulator measures the interval from the previous
+  // step by itself
+  if (_engine != NULL)
+    _engine->schedule(_engine_index, _next_interval, false);
+  else if (_step_deferred)
+    start(_dir_setup);
+  else
+    start( _next_interval - _step_time );
+  _next_step_time = _start_time + _next_interval + late;
+  _jitter_armed = true;
+
+  // The emergency stop could have been triggered after the check above,
+  // in which case the timer must not stay running
+  if (_estop_state == ESTOP_HALT)
+    halt();
 }
 
 void InterruptStepper::start(uint32_t interval) {
+  if (_engine != NULL) {
+    _engine->schedule(_engine_index, interval, true);
+    return;
+  }
+
   // Calculate Timer period
   uint32_t _timer_period = interval - TIMER_SETUP_TIME;
 
@@ -71,6 +254,236 @@ void InterruptStepper::start(uint32_t interval) {
   _timer.start(_timer_period);
 }
 
+void InterruptStepper::stopTimer() {
+  if (_engine != NULL)
+    _engine->stopStepper(_engine_index);
+  else
+    _timer.stop();
+}
+
+void InterruptStepper::step1(long step) {
+  if (_step_port == NO_STEP_PORT || _shift_output != NULL) {
+    if (_engine == NULL) {
+      AccelStepper::step1(step);
+      return;
+    }
+    // The shift register latches all of its outputs at once, so a new
+    // direction is sent in this tick and the step in a later one, once the
+    // direction setup time has passed
+    if (_shift_output != NULL && _direction != _dir_level) {
+      _shift_output->write(_shift_bit, _shift_bits, _direction ? 0b10 : 0b00);
+      _dir_level = _direction;
+      _backlash_dir = _direction;
+      _engine->deferStep(_engine_index);
+      return;
+    }
+    stepPulse();
+    return;
+  }
+
+  // The direction pin is only written when the direction changes. The step
+  // is then delayed by the direction setup time: until the next tick of the
+  // engine, or by the timer which is started with the setup time first.
+  if (_direction != _dir_level) {
+    if (_direction != _dir_inverted)
+      _dir_port->PIO_SODR = _dir_mask;
+    else
+      _dir_port->PIO_CODR = _dir_mask;
+    // The side of the backlash the mechanics rests on is unknown before the
+    // first step. Takeup pulses owed since a stop during the takeup reduce
+    // the backlash in the other direction.
+    if (_direction != _backlash_dir) {
+      if (_backlash_dir >= 0 && _engine == NULL)
+        _takeup = _takeup < _backlash ? _backlash - _takeup : 0;
+      _backlash_dir = _direction;
+    }
+    _dir_level = _direction;
+    if (_dir_setup > 0 || _takeup > 0) {
+      if (_engine != NULL)
+        _engine->deferStep(_engine_index);
+      else
+        _step_deferred = true;
+      return;
+    }
+  }
+  // The takeup was interrupted by a stop, so its remaining pulses come first
+  if (_takeup > 0) {
+    _step_deferred = true;
+    return;
+  }
+  stepPulse();
+}
+
+void InterruptStepper::stepPulse() {
+  if (_shift_output != NULL) {
+    // The direction output was already set, and the step output is cleared
+    // again by the engine in the next tick
+    _shift_output->write(_shift_bit, _shift_bits, 
+                         _dir_level == 1 ? 0b11 : 0b01);
+    _engine->endPulse(_engine_index);
+    return;
+  }
+  if (_step_port == NO_STEP_PORT) {
+    // Same as `AccelStepper::step1()`, but the step pin is set LOW again by
+    // the engine in the next tick
+    setOutputPins(_direction ? 0b10 : 0b00);
+    setOutputPins(_direction ? 0b11 : 0b01);
+    _engine->endPulse(_engine_index);
+    return;
+  }
+  if (_engine != NULL) {
+    // The engine sets the step pins of all the steppers stepping in this
+    // tick with a single write per port
+    _engine->fuseStep(_step_port, _step_mask, _step_inverted);
+    return;
+  }
+  if (_step_inverted)
+    _step_pio->PIO_CODR = _step_mask;
+  else
+    _step_pio->PIO_SODR = _step_mask;
+  delayMicroseconds(_pulse_width);
+  if (_step_inverted)
+    _step_pio->PIO_SODR = _step_mask;
+  else
+    _step_pio->PIO_CODR = _step_mask;
+}
+
+void InterruptStepper::arcStep(bool forward) {
+  _direction = forward ? DIRECTION_CW : DIRECTION_CCW;
+  // A step delayed by a change of direction is made by the interpolator's
+  // timer
+  forward ? stepForward() : stepBackward();
+  _update_func();
+}
+
+uint32_t InterruptStepper::deferredPulse() {
+  stepPulse();
+  if (_takeup > 0) {
+    _takeup--;
+    return _takeup_interval;
+  }
+  _step_deferred = false;
+  return 0;
+}
+
+void InterruptStepper::dropDeferredStep() {
+  if (_engine != NULL) {
+    if (!_engine->cancelStep(_engine_index))
+      return;
+  } else if (!_step_deferred) {
+    return;
+  }
+  _step_deferred = false;
+  _stop_deferred = false;
+  // At the coarse resolution the pulse would have moved the motor by a
+  // whole coarse step
+  long steps = _ms_coarse ? _ms_ratio : 1;
+  _currentPos -= _backlash_dir == DIRECTION_CW ? steps : -steps;
+}
+
+uint32_t InterruptStepper::continueDeferredStep(uint32_t interval) {
+  // The timer was stopped, possibly right after a takeup pulse, so the next
+  // pulse waits for the longer of the two delays
+  uint32_t wait = _dir_setup;
+  if (_backlash > 0 && _takeup_interval > wait)
+    wait = _takeup_interval;
+  _stop_deferred = interval == 0;
+  _next_step_time = micros() + wait + _takeup * _takeup_interval + interval;
+  return wait;
+}
+
+void InterruptStepper::moveFinished() {
+  stopTimer();
+  // The next move starts at the fine resolution, however short it is
+  fineMicrostepping();
+  _move_lateness = 0;
+  if (_homing_state >= HOMING_FAST && _homing_state <= HOMING_SLOW)
+    homingTargetReached();
+  if (_group != NULL)
+    _group->stepperStopped(_group_index);
+}
+
+void InterruptStepper::setDirectionSetupTime(uint16_t setup_time) {
+  _dir_setup = setup_time;
+}
+
+uint16_t InterruptStepper::directionSetupTime() {
+  return _dir_setup;
+}
+
+void InterruptStepper::setBacklash(uint16_t steps, float speed) {
+  _backlash = steps;
+  if (speed > 0.0)
+    _takeup_interval = 1000000.0 / speed;
+}
+
+uint16_t InterruptStepper::backlash() {
+  return _backlash;
+}
+
+void InterruptStepper::setMinPulseWidth(unsigned int minWidth) {
+  if (_engine != NULL && minWidth > _engine->_tick_period)
+    return;
+  AccelStepper::setMinPulseWidth(minWidth);
+  _pulse_width = minWidth;
+}
+
+void InterruptStepper::endStepPulse() {
+  // Writing the chain directly keeps `_dir_level`, so the direction isn't
+  // sent again with the next step
+  if (_shift_output != NULL)
+    _shift_output->write(_shift_bit, _shift_bits, 
+                         _dir_level == 1 ? 0b10 : 0b00);
+  else
+    setOutputPins(_direction ? 0b10 : 0b00);
+}
+
+void InterruptStepper::setOutputPins(uint8_t mask) {
+  // The direction pin may change, so write it again with the next step
+  _dir_level = -1;
+  if (_shift_output != NULL)
+    _shift_output->write(_shift_bit, _shift_bits, mask);
+  else
+    AccelStepper::setOutputPins(mask);
+}
+
+void InterruptStepper::setPinsInverted(bool directionInvert, bool stepInvert, 
+                                       bool enableInvert) {
+  AccelStepper::setPinsInverted(directionInvert, stepInvert, enableInvert);
+  _step_inverted = stepInvert;
+  _dir_inverted = directionInvert;
+  _dir_level = -1;
+}
+
+void InterruptStepper::setPinsInverted(bool pin1Invert, bool pin2Invert, 
+                                       bool pin3Invert, bool pin4Invert, 
+                                       bool enableInvert) {
+  AccelStepper::setPinsInverted(pin1Invert, pin2Invert, pin3Invert, 
+                                pin4Invert, enableInvert);
+  _step_inverted = pin1Invert;
+  _dir_inverted = pin2Invert;
+  _dir_level = -1;
+}
+
+void InterruptStepper::enableOutputs() {
+  if (_shift_output == NULL)
+    AccelStepper::enableOutputs();
+}
+
+bool InterruptStepper::setShiftOutput(ShiftOutput& output, uint8_t first_bit, 
+                                      uint8_t bits) {
+  if (_engine == NULL || _engine->_output != &output)
+    return false;
+  noInterrupts();
+  _shift_output = &output;
+  _shift_bit = first_bit;
+  _shift_bits = bits;
+  interrupts();
+  // Start from the state the pins would have after the constructor
+  setOutputPins(0);
+  return true;
+}
+
 void InterruptStepper::attachInterrupt(void (*isr)()) {
   _timer.attachInterrupt(isr);
 }
@@ -83,16 +496,492 @@ bool InterruptStepper::direction() {
   return _direction;
 }
 
+void InterruptStepper::setMicrostepPins(uint8_t ms1, uint8_t ms2, uint8_t ms3) {
+  _ms_pins[0] = ms1;
+  _ms_pins[1] = ms2;
+  _ms_pins[2] = ms3;
+  for (uint8_t i = 0; i < 3; i++) {
+    if (_ms_pins[i] != 0xff)
+      pinMode(_ms_pins[i], OUTPUT);
+  }
+}
+
+void InterruptStepper::setMicrostepSwitching(float threshold,
+                            uint8_t fine_microsteps, uint8_t fine_mask,
+                            uint8_t coarse_microsteps, uint8_t coarse_mask) {
+  // The coarse resolution needs to evenly divide the fine one
+  if (coarse_microsteps == 0 || fine_microsteps % coarse_microsteps != 0)
+    return;
+
+  _ms_threshold = fabs(threshold);
+  _ms_fine = fine_microsteps;
+  _ms_ratio = fine_microsteps / coarse_microsteps;
+  _ms_fine_mask = fine_mask;
+  _ms_coarse_mask = coarse_mask;
+  _ms_coarse = false;
+  writeMicrostepPins(_ms_fine_mask);
+}
+
+void InterruptStepper::disableMicrostepSwitching() {
+  _ms_ratio = 1;
+  _ms_coarse = false;
+  writeMicrostepPins(_ms_fine_mask);
+}
+
+uint8_t InterruptStepper::microstepRatio() {
+  return _ms_coarse ? _ms_ratio : 1;
+}
+
+void InterruptStepper::setEncoder(QuadratureEncoder& encoder, 
+                  float counts_per_step, uint16_t check_interval, 
+                  long max_error, EncoderMode mode) {
+  _encoder = NULL;
+  // Rounded, since the error of the scale adds up over long moves
+  _enc_scale = (int64_t)round(4294967296.0 / counts_per_step);
+  _enc_interval = check_interval ? check_interval : 1;
+  _enc_steps = 0;
+  _enc_max_error = max_error;
+  _enc_mode = mode;
+  _enc_status = ENCODER_OK;
+  _enc_error = 0;
+  _enc_offset = 0;
+  _enc_offset = _currentPos - encoderToSteps(encoder.read());
+  _enc_last_pos = _enc_last_enc_pos = _currentPos;
+  // Enable the checks only once everything is set up
+  _encoder = &encoder;
+}
+
+void InterruptStepper::removeEncoder() {
+  _encoder = NULL;
+}
+
+uint8_t InterruptStepper::encoderStatus() {
+  return _enc_status;
+}
+
+void InterruptStepper::clearEncoderStatus() {
+  _enc_status = ENCODER_OK;
+}
+
+long InterruptStepper::followingError() {
+  return _enc_error;
+}
+
+long InterruptStepper::encoderPosition() {
+  return _encoder != NULL ? encoderToSteps(_encoder->read()) : _currentPos;
+}
+
+void InterruptStepper::setCurrentPosition(long position) {
+  AccelStepper::setCurrentPosition(position);
+  if (_encoder != NULL) {
+    _enc_offset = 0;
+    _enc_offset = position - encoderToSteps(_encoder->read());
+    _enc_last_pos = _enc_last_enc_pos = position;
+  }
+}
+
+void InterruptStepper::setEndstop(uint8_t pin, bool active_state, bool pullup) {
+  pinMode(pin, pullup ? INPUT_PULLUP : INPUT);
+  _endstop_mask = g_APinDescription[pin].ulPin;
+  _endstop_active = active_state;
+  _endstop_port = g_APinDescription[pin].pPort;
+}
+
+bool InterruptStepper::endstopTriggered() {
+  if (_endstop_port == NULL)
+    return false;
+  // Read the port directly, as this is called after every step while homing
+  return ((_endstop_port->PIO_PDSR & _endstop_mask) != 0) == _endstop_active;
+}
+
+void InterruptStepper::home(bool direction, float fast_speed, float slow_speed,
+                  long backoff, long home_position, long max_travel) {
+  if (_endstop_port == NULL)
+    return;
+
+  stopTimer();
+  _homing_state = HOMING_IDLE;
+  _homing_stopped = false;
+  _homing_dir = direction;
+  _homing_slow_speed = slow_speed;
+  _homing_backoff = labs(backoff);
+  _homing_position = home_position;
+  _homing_travel = labs(max_travel);
+  _homing_saved_speed = _maxSpeed;
+
+  halt();
+  setMaxSpeed(fast_speed);
+
+  // If the endstop is already triggered, skip the fast approach
+  if (endstopTriggered()) {
+    _homing_state = HOMING_FAST;
+    homingTriggered();
+    return;
+  }
+
+  _homing_state = HOMING_FAST;
+  move(_homing_dir ? _homing_travel : -_homing_travel);
+}
+
+InterruptStepper::HomingState InterruptStepper::homingState() {
+  return _homing_state;
+}
+
+long InterruptStepper::homingTriggerPosition() {
+  return _homing_trigger;
+}
+
+void InterruptStepper::attachEmergencyStop(uint8_t pin, uint32_t mode,
+                  EmergencyAction action, bool pullup) {
+  detachEmergencyStop();
+  _estop_action = action;
+  _estop_pin = pin;
+  pinMode(pin, pullup ? INPUT_PULLUP : INPUT);
+  ::attachInterrupt(digitalPinToInterrupt(pin), emergencyStopInterrupt, mode);
+}
+
+void InterruptStepper::detachEmergencyStop() {
+  if (_estop_pin != 0xff) {
+    ::detachInterrupt(digitalPinToInterrupt(_estop_pin));
+    _estop_pin = 0xff;
+  }
+}
+
+void InterruptStepper::emergencyStopInterrupt() {
+  emergencyStop();
+}
+
+void InterruptStepper::emergencyStop() {
+  if (_estopped)
+    return;
+  _estop_time = micros();
+  _estopped = true;
+
+  for (InterruptStepper* s = _first_stepper; s != NULL; s = s->_next_stepper) {
+    // Homing can't continue, as no new moves are accepted
+    if (s->_homing_state >= HOMING_FAST && s->_homing_state <= HOMING_SLOW) {
+      s->_homing_state = HOMING_FAILED;
+      s->_maxSpeed = s->_homing_saved_speed;
+      s->_cmin = 1000000.0 / s->_maxSpeed;
+    }
+
+    if (_estop_action == EMERGENCY_HALT || s->_estop_deceleration == 0.0) {
+      s->_estop_state = ESTOP_HALT;
+      s->halt();
+    } else {
+      s->_estop_state = ESTOP_DECEL_REQUEST;
+    }
+  }
+}
+
+bool InterruptStepper::emergencyStopped() {
+  return _estopped;
+}
+
+bool InterruptStepper::resetEmergencyStop() {
+  for (InterruptStepper* s = _first_stepper; s != NULL; s = s->_next_stepper) {
+    if (s->_estop_state == ESTOP_DECELERATING && s->isRunning())
+      return false;
+  }
+
+  for (InterruptStepper* s = _first_stepper; s != NULL; s = s->_next_stepper) {
+    if (s->_estop_state == ESTOP_DECELERATING)
+      s->setAcceleration(s->_estop_saved_accel);
+    s->_estop_state = ESTOP_NONE;
+  }
+  _estopped = false;
+  return true;
+}
+
+uint32_t InterruptStepper::emergencyStopTime() {
+  return _estop_time;
+}
+
+void InterruptStepper::setEmergencyDeceleration(float deceleration) {
+  _estop_deceleration = fabs(deceleration);
+}
+
+uint32_t InterruptStepper::lastStepTime() {
+  return _start_time;
+}
+
+bool InterruptStepper::playTrajectory(const StepTrajectory& trajectory,
+                  bool reverse, float time_scale) {
+  if (isRunning() || _estopped || _velocity_mode || trajectory.length == 0)
+    return false;
+
+  _traj_reverse = reverse;
+  _traj_remaining = trajectory.length;
+  _traj_index = reverse ? trajectory.length - 1 : 0;
+  _traj_interval = reverse ? trajectory.last : trajectory.first;
+  _traj_scale = (uint32_t)(fabs(time_scale) * 65536.0);
+
+  _direction = reverse ? DIRECTION_CCW : DIRECTION_CW;
+  _targetPos = _currentPos + (reverse ? -(long)trajectory.length 
+                                      : (long)trajectory.length);
+  _trajectory = &trajectory;
+
+  start(scaleInterval(((uint64_t)_traj_interval * _traj_scale) >> 16, 
+                      micros()));
+  return true;
+}
+
+bool InterruptStepper::isPlaying() {
+  return _trajectory != NULL;
+}
+
+void InterruptStepper::setLoadBudget(float budget, uint32_t window) {
+  _load_window = window ? window : 1;
+  _load_budget = constrain(budget, 0.0, 1.0);
+  // Without the governor the steppers return to the full speed, at the same
+  // rate as after an overload
+  if (_load_budget == 0.0) {
+    noInterrupts();
+    rampLoadSpeed(LOAD_SCALE_ONE, micros());
+    interrupts();
+  }
+}
+
+float InterruptStepper::interruptLoad() {
+  return _load;
+}
+
+float InterruptStepper::loadSpeedScale() {
+  return (float)currentLoadSpeed(micros()) / LOAD_SCALE_ONE;
+}
+
+void InterruptStepper::setFeedOverride(float factor) {
+  factor = constrain(factor, FEED_OVERRIDE_MIN, FEED_OVERRIDE_MAX);
+
+  float rate = speedRampRate();
+
+  uint32_t target = factor * LOAD_SCALE_ONE;
+  noInterrupts();
+  uint32_t now = micros();
+  _feed_from = rate > 0.0 ? currentFeedOverride(now) : target;
+  _feed_to = target;
+  _feed_ramp_start = now;
+  _feed_rate = fixedRampRate(rate);
+  _feed_scale = 0xffffffffUL / target + 1;
+  interrupts();
+}
+
+float InterruptStepper::feedOverride() {
+  return (float)_feed_to / LOAD_SCALE_ONE;
+}
+
+float InterruptStepper::speedRampRate() {
+  // The fastest change of the factor that keeps every stepper within its
+  // acceleration, even at its max speed
+  float rate = 0.0;
+  for (InterruptStepper* s = _first_stepper; s != NULL; s = s->_next_stepper) {
+    if (s->_maxSpeed <= 0.0 || s->_acceleration <= 0.0)
+      continue;
+    float stepper_rate = s->_acceleration / s->_maxSpeed;
+    if (rate == 0.0 || stepper_rate < rate)
+      rate = stepper_rate;
+  }
+  return rate;
+}
+
+uint32_t InterruptStepper::fixedRampRate(float rate) {
+  // From units per second to 16.16 units per 2^20 μs
+  uint32_t fixed = rate * LOAD_SCALE_ONE * ((1UL << RAMP_SHIFT) / 1000000.0);
+  return fixed ? fixed : 1;
+}
+
+uint32_t InterruptStepper::rampValue(uint32_t from, uint32_t to, 
+                                     uint32_t start, uint32_t rate, 
+                                     uint32_t now) {
+  if (from == to)
+    return to;
+  uint32_t change = ((uint64_t)(now - start) * rate) >> RAMP_SHIFT;
+  if (to > from)
+    return change >= to - from ? to : from + change;
+  return change >= from - to ? to : from - change;
+}
+
+uint32_t InterruptStepper::currentFeedOverride(uint32_t now) {
+  return rampValue(_feed_from, _feed_to, _feed_ramp_start, _feed_rate, now);
+}
+
+uint32_t InterruptStepper::currentLoadSpeed(uint32_t now) {
+  return rampValue(_load_from, _load_to, _load_ramp_start, _load_rate, now);
+}
+
+void InterruptStepper::rampLoadSpeed(uint32_t target, uint32_t now) {
+  float rate = speedRampRate();
+  _load_from = rate > 0.0 ? currentLoadSpeed(now) : target;
+  _load_to = target;
+  _load_ramp_start = now;
+  _load_rate = fixedRampRate(rate);
+  _load_scale = 0xffffffffUL / target + 1;
+}
+
+uint32_t InterruptStepper::loadScale(uint32_t now) {
+  if (_load_from == _load_to)
+    return _load_scale;
+  uint32_t speed = currentLoadSpeed(now);
+  // The ramp is over, as in `feedScale()`
+  if (speed == _load_to) {
+    _load_from = speed;
+    return _load_scale;
+  }
+  return 0xffffffffUL / speed + 1;
+}
+
+uint32_t InterruptStepper::feedScale(uint32_t now) {
+  if (_feed_from == _feed_to)
+    return _feed_scale;
+  uint32_t factor = currentFeedOverride(now);
+  // The ramp is over, so the next steps can skip the computation. Every
+  // interrupt would write the same values.
+  if (factor == _feed_to) {
+    _feed_from = factor;
+    return _feed_scale;
+  }
+  return 0xffffffffUL / factor + 1;
+}
+
+uint32_t InterruptStepper::scaleInterval(uint32_t interval, uint32_t now) {
+  // Slow down all the steppers by the same factor if the load governor
+  // detected an overload
+  uint32_t load_scale = loadScale(now);
+  if (load_scale != LOAD_SCALE_ONE)
+    interval = ((uint64_t)interval * load_scale) >> 16;
+  // Apply the feed override, which only changes the intervals and not the
+  // speed profile
+  uint32_t feed_scale = feedScale(now);
+  if (feed_scale != LOAD_SCALE_ONE)
+    interval = ((uint64_t)interval * feed_scale) >> 16;
+  return interval;
+}
+
+void InterruptStepper::setInterruptPriority(uint8_t priority) {
+  int irq = timerIRQn(_timer);
+  if (irq >= 0)
+    NVIC_SetPriority((IRQn_Type)irq, priority);
+}
+
+uint8_t InterruptStepper::interruptPriority() {
+  int irq = timerIRQn(_timer);
+  return irq >= 0 ? NVIC_GetPriority((IRQn_Type)irq) : 0;
+}
+
+void InterruptStepper::assignInterruptPriorities(uint8_t highest) {
+  for (InterruptStepper* s = _first_stepper; s != NULL; s = s->_next_stepper) {
+    // The priority is the number of distinct max speeds higher than this one
+    uint8_t priority = highest;
+    for (InterruptStepper* t = _first_stepper; t != NULL; t = t->_next_stepper) {
+      bool counted = false;
+      for (InterruptStepper* u = _first_stepper; u != t; u = u->_next_stepper)
+        counted |= u->_maxSpeed == t->_maxSpeed;
+      if (!counted && t->_maxSpeed > s->_maxSpeed)
+        priority++;
+    }
+    s->setInterruptPriority(min(priority, (1 << __NVIC_PRIO_BITS) - 1));
+  }
+}
+
+uint32_t InterruptStepper::maxStepJitter() {
+  return _max_jitter;
+}
+
+void InterruptStepper::resetStepJitter() {
+  _max_jitter = 0;
+}
+
+void InterruptStepper::setLatenessPolicy(LatenessPolicy policy, 
+                                         uint32_t fault_threshold) {
+  _lateness_policy = policy;
+  _lateness_threshold = fault_threshold;
+}
+
+uint32_t InterruptStepper::missedDeadlines() {
+  return _missed_deadlines;
+}
+
+uint32_t InterruptStepper::totalLateness() {
+  return _total_lateness;
+}
+
+uint32_t InterruptStepper::maxLateness() {
+  return _max_lateness;
+}
+
+uint32_t InterruptStepper::moveLateness() {
+  return _move_lateness;
+}
+
+bool InterruptStepper::latenessFault() {
+  return _lateness_fault;
+}
+
+void InterruptStepper::resetLatenessCounters() {
+  noInterrupts();
+  _missed_deadlines = 0;
+  _total_lateness = 0;
+  _max_lateness = 0;
+  _lateness_fault = false;
+  interrupts();
+}
+
+void InterruptStepper::startVelocityLoop(PrecDueTimer& timer, float frequency,
+                                         uint8_t priority) {
+  stopVelocityLoop();
+  _velocity_dt = 1.0 / frequency;
+  _velocity_timer = &timer;
+  timer.attachInterrupt(velocityLoopInterrupt);
+  int irq = timerIRQn(timer);
+  if (irq >= 0)
+    NVIC_SetPriority((IRQn_Type)irq, priority);
+  timer.start(1000000.0 / frequency);
+}
+
+void InterruptStepper::stopVelocityLoop() {
+  if (_velocity_timer != NULL) {
+    _velocity_timer->stop();
+    _velocity_timer->detachInterrupt();
+    _velocity_timer = NULL;
+  }
+}
+
+bool InterruptStepper::setVelocityMode(bool enable) {
+  // The steps of a held group can't be rescheduled by the velocity loop
+  if (isRunning() || (enable && _group != NULL && _group->isHolding()))
+    return false;
+  _velocity_mode = enable;
+  _velocity_stepping = false;
+  return true;
+}
+
+bool InterruptStepper::velocityMode() {
+  return _velocity_mode;
+}
+
 bool InterruptStepper::run() {
   return AccelStepper::isRunning();
 }
 
+bool InterruptStepper::isRunning() {
+  return AccelStepper::isRunning() || _step_deferred;
+}
+
 void InterruptStepper::moveTo(long absolute) {
+  if (_estopped)
+    return;
+  // The velocity loop takes care of the new target in its next update
+  if (_velocity_mode) {
+    _targetPos = absolute;
+    checkCoarseTarget();
+    return;
+  }
   if (_targetPos != absolute) {
     // Stop currently scheduled interrupts if max_speed needs to change
-    _timer.stop();
+    stopTimer();
     // Then perform calculations as normal
     _targetPos = absolute;
+    checkCoarseTarget();
     computeNewSpeed();
     // compute new n?
   }
@@ -105,9 +994,14 @@ void InterruptStepper::move(long relative) {
 void InterruptStepper::setMaxSpeed(float speed) {
   if (speed < 0.0)
     speed = -speed;
+  if (_velocity_mode) {
+    _maxSpeed = speed;
+    _cmin = 1000000.0 / speed;
+    return;
+  }
   if (_maxSpeed != speed) {
     // Stop currently scheduled interrupts if max_speed needs to change
-    _timer.stop();
+    stopTimer();
     // Then perform calculations as normal
     _maxSpeed = speed;
     _cmin = 1000000.0 / speed;
@@ -126,9 +1020,13 @@ void InterruptStepper::setAcceleration(float acceleration) {
 	  return;
   if (acceleration < 0.0)
     acceleration = -acceleration;
+  if (_velocity_mode) {
+    _acceleration = acceleration;
+    return;
+  }
   if (_acceleration != acceleration) {
     // Stop currently scheduled interrupts if max_speed needs to change
-    _timer.stop();
+    stopTimer();
     // Then perform calculations as normal
     // Recompute _n per Equation 17
     _n = _n * (_acceleration / acceleration);
@@ -140,6 +1038,23 @@ void InterruptStepper::setAcceleration(float acceleration) {
 }
 
 void InterruptStepper::stop() {
+  // Homing ends once the motor stops, whatever phase it was in
+  if (_homing_state >= HOMING_FAST && _homing_state <= HOMING_SLOW)
+    _homing_stopped = true;
+  if (_velocity_mode && _shaper != NULL) {
+    // The shaped motion follows the reference motion, so it's the reference
+    // that has to stop
+    noInterrupts();
+    float position = _ref_position;
+    float speed = _ref_speed;
+    interrupts();
+    if (speed != 0.0) {
+      long stepsToStop = (long)((speed * speed) / (2.0 * _acceleration)) + 1;
+      moveTo(speed > 0 ? ceil(position) + stepsToStop 
+                       : floor(position) - stepsToStop);
+    }
+    return;
+  }
   if (_speed != 0.0) {    
 	  long stepsToStop = (long)((_speed * _speed) / (2.0 * _acceleration)) + 1; // Equation 16 (+integer rounding)
 	  if (_speed > 0)
@@ -152,8 +1067,404 @@ void InterruptStepper::stop() {
 // Stop the timer and detach the interrupt if the object is destroyed or
 // goes out of scope
 InterruptStepper::~InterruptStepper() {
-  _timer.stop();
+  stopTimer();
   detachInterrupt();
+
+  // Remove the stepper from the list of all steppers
+  InterruptStepper** s = &_first_stepper;
+  while (*s != this)
+    s = &(*s)->_next_stepper;
+  *s = _next_stepper;
+}
+
+void InterruptStepper::updateMicrostepping() {
+  // Only switch on full step positions. Coarse steps evenly divide a full
+  // step, so the motor always passes through them at both resolutions.
+  if (_currentPos % _ms_fine != 0)
+    return;
+
+  long distance = distanceToGo();
+  // Use the coarse resolution only when moving fast towards a target that is
+  // far enough away to switch back on one of the following full steps
+  bool coarse = fabs(_speed) >= _ms_threshold 
+                && labs(distance) >= 2 * _ms_fine
+                && (distance > 0) == (_direction == DIRECTION_CW);
+
+  if (coarse != _ms_coarse) {
+    _ms_coarse = coarse;
+    writeMicrostepPins(coarse ? _ms_coarse_mask : _ms_fine_mask);
+  }
+}
+
+void InterruptStepper::fineMicrostepping() {
+  if (!_ms_coarse)
+    return;
+  _ms_coarse = false;
+  writeMicrostepPins(_ms_fine_mask);
+}
+
+void InterruptStepper::checkCoarseTarget() {
+  if (!_ms_coarse)
+    return;
+  long distance = distanceToGo();
+  if (labs(distance) < 2 * _ms_fine 
+      || (distance > 0) != (_direction == DIRECTION_CW))
+    fineMicrostepping();
+}
+
+void InterruptStepper::writeMicrostepPins(uint8_t mask) {
+  for (uint8_t i = 0; i < 3; i++) {
+    if (_ms_pins[i] != 0xff)
+      digitalWrite(_ms_pins[i], (mask & (1 << i)) ? HIGH : LOW);
+  }
+}
+
+bool InterruptStepper::checkEncoder() {
+  _enc_steps = 0;
+
+  long position = encoderToSteps(_encoder->read());
+  long error = _currentPos - position;
+  _enc_error = error;
+
+  uint8_t status = ENCODER_OK;
+  if (labs(error) > _enc_max_error)
+    status |= ENCODER_FOLLOWING_ERROR;
+  if (2 * labs(position - _enc_last_enc_pos) < labs(_currentPos - _enc_last_pos))
+    status |= ENCODER_STALL;
+
+  if (status != ENCODER_OK) {
+    _enc_status |= status;
+    if (_enc_mode == ENCODER_STOP)
+      return false;
+    if (_enc_mode == ENCODER_CORRECT)
+      _currentPos = position;
+  }
+
+  _enc_last_pos = _currentPos;
+  _enc_last_enc_pos = position;
+  return true;
+}
+
+long InterruptStepper::encoderToSteps(int32_t count) {
+  // Rounded to the nearest step
+  return (long)(((int64_t)count * _enc_scale + (1LL << 31)) >> 32) 
+         + _enc_offset;
+}
+
+void InterruptStepper::halt() {
+  stopTimer();
+  // No more pulses are made after a halt
+  dropDeferredStep();
+  fineMicrostepping();
+  if (_shaper != NULL)
+    resetShaping();
+  _jitter_armed = false;
+  _velocity_stepping = false;
+  _trajectory = NULL;
+  _move_lateness = 0;
+  _targetPos = _currentPos;
+  _stepInterval = 0;
+  _speed = 0.0;
+  _n = 0;
+  if (_group != NULL)
+    _group->stepperHalted(_group_index);
+}
+
+void InterruptStepper::homingTriggered() {
+  halt();
+
+  if (_homing_stopped) {
+    // The endstop was reached while stopping
+    setMaxSpeed(_homing_saved_speed);
+    _homing_state = HOMING_FAILED;
+  } else if (_homing_state == HOMING_FAST) {
+    // Back off from the endstop
+    _homing_state = HOMING_BACKOFF;
+    setMaxSpeed(_homing_slow_speed);
+    move(_homing_dir ? -_homing_backoff : _homing_backoff);
+  } else {
+    // Set the home position straight away, while still in the interrupt
+    _homing_trigger = _currentPos;
+    setCurrentPosition(_homing_position);
+    setMaxSpeed(_homing_saved_speed);
+    _homing_state = HOMING_DONE;
+  }
+}
+
+void InterruptStepper::homingTargetReached() {
+  if (_homing_state == HOMING_BACKOFF && !_homing_stopped) {
+    // Approach the endstop again, this time slowly
+    _homing_state = HOMING_SLOW;
+    move(_homing_dir ? _homing_travel : -_homing_travel);
+  } else {
+    // The endstop wasn't found or the homing was stopped
+    setMaxSpeed(_homing_saved_speed);
+    _homing_state = HOMING_FAILED;
+  }
+}
+
+bool InterruptStepper::emergencyStep() {
+  if (_estop_state == ESTOP_HALT) {
+    halt();
+    return false;
+  }
+
+  if (_estop_state == ESTOP_DECEL_REQUEST) {
+    // Hand a playing trajectory over to the speed profile at its current speed
+    if (_trajectory != NULL) {
+      _trajectory = NULL;
+      _cn = ((uint64_t)_traj_interval * _traj_scale) >> 16;
+      _speed = _direction == DIRECTION_CW ? 1000000.0 / _cn : -1000000.0 / _cn;
+    }
+
+    // Decelerate from the current speed at the emergency deceleration
+    _estop_saved_accel = _acceleration;
+    _acceleration = _estop_deceleration;
+    long stepsToStop = (long)((_speed * _speed) / (2.0 * _acceleration)); // Equation 16
+    // +1 for the step made in this interrupt
+    _targetPos = _currentPos + 
+                 (_direction == DIRECTION_CW ? stepsToStop + 1 : -stepsToStop - 1);
+    checkCoarseTarget();
+    _n = -stepsToStop;
+    _estop_state = ESTOP_DECELERATING;
+  }
+  return true;
+}
+
+uint32_t InterruptStepper::nextTrajectoryInterval() {
+  if (--_traj_remaining == 0) {
+    _trajectory = NULL;
+    return 0;
+  }
+
+  if (_traj_reverse)
+    _traj_interval -= _trajectory->deltas[--_traj_index];
+  else
+    _traj_interval += _trajectory->deltas[_traj_index++];
+
+  return ((uint64_t)_traj_interval * _traj_scale) >> 16;
+}
+
+void InterruptStepper::updateLoadGovernor(uint32_t now) {
+  uint32_t elapsed = now - _load_window_start;
+  _load = elapsed ? (float)_load_busy / elapsed : 0.0;
+  _load_busy = 0;
+  _load_window_start = now;
+
+  if (_load_budget == 0.0)
+    return;
+
+  // The load is proportional to the step rate, so aim for the speed at which
+  // the steppers would use exactly the budget. The speed is ramped towards
+  // it like the feed override, so that no stepper exceeds its acceleration.
+  float speed = (float)currentLoadSpeed(now) / LOAD_SCALE_ONE;
+  float target = _load > 0.0 ? speed * _load_budget / _load : 1.0;
+  target = constrain(target, speed / LOAD_SCALE_STEP, speed * LOAD_SCALE_STEP);
+  target = constrain(target, LOAD_SCALE_MIN_SPEED, 1.0);
+  rampLoadSpeed(target * LOAD_SCALE_ONE, now);
+}
+
+void InterruptStepper::catchUp() {
+  // At the interval c the acceleration a allows the speed to rise by a*c in
+  // one step, which shortens the interval by about a*c^3 (c in seconds)
+  float c = _next_interval * 1e-6f;
+  uint32_t limit = _acceleration * c * c * c * 1e6f;
+  // Don't shorten the interval so much that the step would be late again
+  uint32_t min_interval = _step_time + TIMER_SETUP_TIME + MIN_PERIOD_TIME;
+  uint32_t slack = _next_interval > min_interval ? _next_interval - min_interval : 0;
+  
+  uint32_t shorten = min(min(limit, slack), (uint32_t)_move_lateness);
+  _next_interval -= shorten;
+  _move_lateness -= shorten;
+}
+
+uint32_t InterruptStepper::checkDeadline() {
+  // The same condition under which `start()` replaces the period with
+  // MIN_PERIOD_TIME
+  uint32_t min_interval = _step_time + TIMER_SETUP_TIME + MIN_PERIOD_TIME;
+  if (_next_interval >= min_interval)
+    return 0;
+
+  uint32_t late = min_interval - _next_interval;
+  _missed_deadlines++;
+  _total_lateness += late;
+  _move_lateness += late;
+  if (late > _max_lateness)
+    _max_lateness = late;
+  return late;
+}
+
+uint32_t InterruptStepper::velocityInterval() {
+  // The step interrupt stops at the target, the velocity loop everywhere
+  // else. Only a motor at the creep speed can stop within a step, so after a
+  // new target within the stopping distance the motor passes it and the
+  // velocity loop brings it back, like in AccelStepper.
+  bool creeping = _speed * _speed <= 2.0 * _acceleration * 1.01;
+  if ((_currentPos == _targetPos && creeping) || _stepInterval == 0) {
+    _velocity_stepping = false;
+    return 0;
+  }
+  _period_start = _start_time;
+  return _stepInterval;
+}
+
+void InterruptStepper::velocityLoopInterrupt() {
+  for (InterruptStepper* s = _first_stepper; s != NULL; s = s->_next_stepper) {
+    if (s->_velocity_mode)
+      s->velocityUpdate(_velocity_dt);
+  }
+}
+
+void InterruptStepper::velocityUpdate(float dt) {
+  bool stepping = _velocity_stepping;
+  long distance = _targetPos - _currentPos;
+  if (!stepping && distance == 0) {
+    _speed = 0.0;
+    // The rest of the shaped motion is shorter than a step
+    if (_shaper != NULL && !_shaper->idle())
+      resetShaping();
+    return;
+  }
+  // The motor is stationary whenever the timer isn't running
+  float v = stepping ? _speed : 0.0;
+  if (_shaper != NULL)
+    v = shapedSpeed(v, distance, dt);
+  else
+    v = plannedSpeed(v, distance, dt);
+  float speed = fabs(v);
+  uint32_t interval = speed > 0.0 ? 1000000.0 / speed : 0;
+
+  noInterrupts();
+  // The step interrupt stopped at the target in the meantime
+  if (_velocity_stepping != stepping) {
+    interrupts();
+    return;
+  }
+  _speed = v;
+  _jitter_armed = false;
+  if (interval == 0) {
+    // A step delayed by a change of direction is still made by the timer
+    if (_step_deferred) {
+      continueDeferredStep(0);
+    } else {
+      stopTimer();
+      fineMicrostepping();
+    }
+    _velocity_stepping = false;
+    _stepInterval = 0;
+  } else if (!stepping) {
+    _direction = v > 0.0 ? DIRECTION_CW : DIRECTION_CCW;
+    _stepInterval = interval;
+    _velocity_stepping = true;
+    _period_start = micros();
+    uint32_t scaled = scaleInterval(interval, _period_start);
+    // The timer is still running for the step delayed by a change of
+    // direction at the end of the previous move
+    if (_step_deferred)
+      continueDeferredStep(scaled);
+    else
+      start(scaled);
+  } else if (interval != _stepInterval) {
+    // The shaped speed can change its sign without stopping
+    _direction = v > 0.0 ? DIRECTION_CW : DIRECTION_CCW;
+    // Reschedule the pending step at the new speed
+    _stepInterval = interval;
+    uint32_t now = micros();
+    uint32_t scaled = scaleInterval(interval, now);
+    uint32_t elapsed = now - _period_start;
+    // The deferred step and the takeup pulses keep their own timing
+    if (!_step_deferred)
+      start(scaled > elapsed ? scaled - elapsed : 0);
+  }
+  interrupts();
+}
+
+float InterruptStepper::plannedSpeed(float v, long distance, float dt) {
+  float speed = fabs(v);
+  bool toward = distance != 0 && (v == 0.0 || (distance > 0) == (v > 0.0));
+
+  // Accelerate towards the max speed while the target is further than the
+  // stopping distance plus the distance travelled until the next update
+  if (toward && speed * speed / (2.0 * _acceleration) + speed * dt < labs(distance)) {
+    if (speed > _maxSpeed)
+      speed = max(speed - _acceleration * dt, _maxSpeed);
+    else
+      speed = min(speed + _acceleration * dt, _maxSpeed);
+  } else {
+    speed = max(speed - _acceleration * dt, 0.0f);
+  }
+  // Start moving and creep over the last steps at the speed from which the
+  // motor can stop within a single step, instead of stopping short of the
+  // target. The step interrupt stops exactly at the target.
+  if (toward)
+    speed = max(speed, min((float)sqrt(2.0 * _acceleration), _maxSpeed));
+
+  if (v == 0.0)
+    return distance > 0 ? speed : -speed;
+  return v > 0.0 ? speed : -speed;
+}
+
+float InterruptStepper::shapedSpeed(float v, long distance, float dt) {
+  // A new move starts from where the motor is
+  if (!_velocity_stepping && _shaper->idle()) {
+    _ref_position = _currentPos;
+    _ref_speed = 0.0;
+  }
+
+  // The unshaped reference motion is planned like an unshaped stepper, but
+  // on a position of its own, and lands exactly on the target
+  float ref_distance = _targetPos - _ref_position;
+  long whole = ref_distance > 0 ? ceil(ref_distance) : floor(ref_distance);
+  float ref_speed = plannedSpeed(_ref_speed, whole, dt);
+  float travel = ref_speed * dt;
+  if (ref_distance != 0.0 && (travel > 0.0) == (ref_distance > 0.0) 
+      && fabs(travel) >= fabs(ref_distance)) {
+    travel = ref_distance;
+    ref_speed = 0.0;
+  }
+  _ref_position += travel;
+  _ref_speed = ref_speed;
+
+  float shaped = _shaper->shape(travel / dt, dt);
+  // Once the shaped motion is over, the steps still missing due to rounding
+  // are made without shaping
+  if (_shaper->idle())
+    return plannedSpeed(v, distance, dt);
+  return shaped;
+}
+
+void InterruptStepper::resetShaping() {
+  _shaper->reset();
+  _ref_position = _currentPos;
+  _ref_speed = 0.0;
+}
+
+bool InterruptStepper::setInputShaper(InputShaper* shaper) {
+  if (isRunning())
+    return false;
+  if (shaper != NULL && shaper->duration() / _velocity_dt 
+                        > INPUT_SHAPER_MAX_SAMPLES - 2)
+    return false;
+  _shaper = shaper;
+  if (_shaper != NULL)
+    resetShaping();
+  return true;
+}
+
+InputShaper* InterruptStepper::inputShaper() {
+  return _shaper;
+}
+
+int InterruptStepper::timerIRQn(PrecDueTimer& timer) {
+  // The timers are consecutive channels of the TC0, TC1 and TC2 counters,
+  // whose interrupts are numbered consecutively as well
+  PrecDueTimer* timers[] = { &Timer0, &Timer1, &Timer2, &Timer3, &Timer4, 
+                             &Timer5, &Timer6, &Timer7, &Timer8 };
+  for (int i = 0; i < 9; i++) {
+    if (&timer == timers[i])
+      return TC0_IRQn + i;
+  }
+  return -1;
 }
 
 uint32_t InterruptStepper::getNextInterval() { 
@@ -161,14 +1472,30 @@ uint32_t InterruptStepper::getNextInterval() {
 }
 
 uint32_t InterruptStepper::computeNewSpeed() {
+  // In the velocity mode only the velocity loop schedules the steps
+  if (_velocity_mode)
+    return _stepInterval;
+  // The step is rescheduled, so it can't be used to measure the jitter
+  _jitter_armed = false;
   // Use the base method to compute the interval until the next step
   uint32_t interval = AccelStepper::computeNewSpeed();
+  uint32_t now = micros();
+  uint32_t scaled = interval ? scaleInterval(interval, now) : 0;
+  // The step delayed by a change of direction is made first, and the
+  // replanned move goes on from it
+  if (_step_deferred) {
+    start(continueDeferredStep(scaled));
+    return interval;
+  }
+  // Don't schedule a step if the motor should be stationary
+  if (interval == 0)
+    return interval;
   // How much time has passed already since the last step
-  uint32_t time_since_step = micros() - _start_time;
+  uint32_t time_since_step = now - _start_time;
   // We check whether the time since the last step is smaller than the interval.
   // If so then we wait an appropriate amount of time with the next step, 
   // otherwise we step immidietaly.
-  time_since_step < interval ? start( interval - time_since_step ) : start();
+  time_since_step < scaled ? start( scaled - time_since_step ) : start();
   
   return interval;
 }
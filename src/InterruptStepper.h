@@ -12,10 +12,59 @@
 #define INTERRUPT_STEPPER_H
 
 #include <PrecDueTimer.h>
+#include "InterruptStepperConfig.h"
 #include "AccelStepper/AccelStepper.h"
+#include "QuadratureEncoder.h"
+#include "StepTrajectory.h"
+#include "ShiftOutput.h"
+#include "InputShaper.h"
+
+// Load governor scale (16.16 fixed point) at which steppers run at full speed
+#define LOAD_SCALE_ONE 65536
+
+class StepperGroup;
+class StepEngine;
 
 class InterruptStepper : public AccelStepper {
 public:
+  // Actions taken when the encoder check detects a problem
+  enum EncoderMode {
+    ENCODER_MONITOR, // Only set the status flags
+    ENCODER_CORRECT, // Also set the current position to the encoder position
+    ENCODER_STOP     // Also stop the motor immediately
+  };
+
+  // Status flags returned by `encoderStatus()`
+  enum EncoderStatus {
+    ENCODER_OK              = 0,
+    ENCODER_FOLLOWING_ERROR = 1 << 0, // Position differs by more than allowed
+    ENCODER_STALL           = 1 << 1  // Motor moved less than half the steps
+  };
+
+  // Homing phases returned by `homingState()`
+  enum HomingState {
+    HOMING_IDLE,    // Homing was never started
+    HOMING_FAST,    // Fast approach towards the endstop
+    HOMING_BACKOFF, // Backing off from the endstop
+    HOMING_SLOW,    // Slow approach towards the endstop
+    HOMING_DONE,    // The current position was set to the home position
+    HOMING_FAILED   // Endstop not found or homing interrupted by `stop()`
+  };
+
+  // Actions performed by all steppers when the emergency stop is triggered
+  enum EmergencyAction {
+    EMERGENCY_HALT,      // Stop stepping immediately
+    EMERGENCY_DECELERATE // Decelerate at the emergency deceleration
+  };
+
+  // What to do when a step interrupt takes too long to schedule the next
+  // step on time
+  enum LatenessPolicy {
+    LATENESS_ABSORB,   // Make the step late, stretching the speed profile
+    LATENESS_CATCH_UP, // Shorten the next intervals within the acceleration
+    LATENESS_FAULT     // Stop the motor once the move is too late
+  };
+
   // The constructor where you need to manually provide an available timer.
   // There are 9 timers defined in the `DueTimer` library and they are 
   // `DueTimer::Timer0` to `DueTimer::Timer8`. You can also call the static
@@ -34,11 +83,11 @@ public:
                   void (*forward)(), void (*backward)());
 
   // An interrupt function that performs the entire stepping logic.
-  void stepInterrupt();
+  INTERRUPT_STEPPER_RAMFUNC void stepInterrupt();
 
   // Make a step and begin the whole stepping logic, after the specified
   // interval (in μs)
-  void start(uint32_t interval = 0);
+  INTERRUPT_STEPPER_RAMFUNC void start(uint32_t interval = 0);
 
   // Attach interrupt to the Timer
   void attachInterrupt(void (*isr)());
@@ -51,11 +100,282 @@ public:
   // the output of this method is undefined.
   bool direction();
 
+  // Sets the pins connected to the MS1, MS2 and MS3 microstep resolution
+  // inputs of the stepper driver. Pass 0xff for the pins that are not used.
+  void setMicrostepPins(uint8_t ms1, uint8_t ms2 = 0xff, uint8_t ms3 = 0xff);
+
+  // Enables dynamic microstep switching (`DRIVER` interface only). Above the
+  // `threshold` speed the driver is switched from the `fine_microsteps`
+  // resolution (driver pins set according to `fine_mask`) to the
+  // `coarse_microsteps` resolution (`coarse_mask`), so that a single pulse
+  // moves the motor by several fine microsteps. Positions, speeds and
+  // accelerations are always expressed in fine microsteps. The resolution
+  // only changes on full step positions and the motor is switched back to the
+  // fine resolution while decelerating below the threshold or when it gets
+  // closer than 2 full steps to the target.
+  // Bit 0 of the masks corresponds to MS1, bit 1 to MS2 and bit 2 to MS3.
+  void setMicrostepSwitching(float threshold,
+                            uint8_t fine_microsteps, uint8_t fine_mask,
+                            uint8_t coarse_microsteps, uint8_t coarse_mask);
+
+  // Disables dynamic microstep switching and returns the driver to the fine
+  // resolution. Should only be called when the motor is stationary.
+  void disableMicrostepSwitching();
+
+  // Returns how many fine microsteps the motor moves by with each pulse
+  // (1 if the driver is currently running at the fine resolution).
+  uint8_t microstepRatio();
+
+  // Enables closed loop monitoring of the motor position using an encoder
+  // that was already started with `QuadratureEncoder::begin()`. The current
+  // position of the motor is taken to correspond to the current encoder count.
+  // Every `check_interval` steps the interrupt compares the encoder position
+  // with `currentPosition()`. If they differ by more than `max_error` steps
+  // a following error is flagged, and if the motor moved by less than half
+  // of the commanded steps since the last check a stall is flagged. The `mode`
+  // decides what else happens when a problem is detected.
+  void setEncoder(QuadratureEncoder& encoder, float counts_per_step,
+                  uint16_t check_interval = 16, long max_error = 8,
+                  EncoderMode mode = ENCODER_MONITOR);
+
+  // Disables the encoder monitoring.
+  void removeEncoder();
+
+  // Returns the `EncoderStatus` flags set since the last call to
+  // `clearEncoderStatus()`.
+  uint8_t encoderStatus();
+  // Clears the encoder status flags.
+  void clearEncoderStatus();
+
+  // Returns the difference (in steps) between the current position and the
+  // encoder position measured during the last check.
+  long followingError();
+
+  // Returns the current encoder position converted to steps.
+  long encoderPosition();
+
+  // Overridden from the AccelStepper library so that the encoder position
+  // is kept in sync with the new current position.
+  void setCurrentPosition(long position);
+
+  // Sets the pin connected to the endstop used for homing. `active_state` is
+  // the state of the pin when the endstop is triggered. If `pullup` is true
+  // the internal pull-up resistor of the pin is enabled.
+  void setEndstop(uint8_t pin, bool active_state = LOW, bool pullup = true);
+
+  // Returns true if the endstop is currently triggered.
+  INTERRUPT_STEPPER_RAMFUNC bool endstopTriggered();
+
+  // Starts homing the motor. The motor first moves towards the endstop in
+  // the given `direction` (1 means clockwise) at `fast_speed`, backs off by
+  // `backoff` steps once the endstop is triggered and then approaches it again
+  // at `slow_speed`. The endstop is checked in the interrupt after every step,
+  // so the motor stops within one step of the trigger. When it gets triggered
+  // during the slow approach the current position is set to `home_position`.
+  // Homing fails if the endstop isn't found within `max_travel` steps.
+  // The method returns immediately, use `homingState()` to check the progress.
+  void home(bool direction, float fast_speed, float slow_speed, long backoff,
+            long home_position = 0, long max_travel = 1000000000L);
+
+  // Returns the current `HomingState`.
+  HomingState homingState();
+
+  // Returns the position (before it was set to the home position) at which
+  // the endstop got triggered during the slow approach of the last homing.
+  // Comparing this value between subsequent homings shows their repeatability.
+  long homingTriggerPosition();
+
+  // Binds the emergency stop to an input pin. The pin interrupt triggered by
+  // `mode` (`FALLING`, `RISING` or `CHANGE`) calls `emergencyStop()` straight
+  // away, without any involvement of the main loop.
+  static void attachEmergencyStop(uint8_t pin, uint32_t mode = FALLING,
+                  EmergencyAction action = EMERGENCY_HALT, bool pullup = true);
+  // Unbinds the emergency stop from the input pin.
+  static void detachEmergencyStop();
+
+  // Stops all existing steppers. With `EMERGENCY_HALT` their timers are
+  // stopped right away. With `EMERGENCY_DECELERATE` each stepper decelerates
+  // at its emergency deceleration, computed in its next interrupt (steppers
+  // without an emergency deceleration set are halted instead). Until
+  // `resetEmergencyStop()` is called `moveTo()` and `move()` have no effect.
+  // Can be called from an interrupt.
+  static void emergencyStop();
+  // Returns true if the emergency stop was triggered and not reset yet.
+  static bool emergencyStopped();
+  // Allows the steppers to move again. Returns false (and does nothing) if
+  // any of the steppers is still decelerating.
+  static bool resetEmergencyStop();
+  // Returns the time (`micros()`) at which the emergency stop was triggered.
+  static uint32_t emergencyStopTime();
+
+  // Sets the deceleration (in steps/s^2) used by `EMERGENCY_DECELERATE`.
+  void setEmergencyDeceleration(float deceleration);
+
+  // Returns the time (`micros()`) at which the last step interrupt started.
+  uint32_t lastStepTime();
+
+  // Plays back a precomputed trajectory. The interrupt only reads the next
+  // interval from the table, without computing any speed profile. Played
+  // forward the motor moves `trajectory.length` steps clockwise. Played in
+  // `reverse` it moves counterclockwise, with the intervals in the reverse
+  // order, retracing the forward move. `time_scale` multiplies all the
+  // intervals (e.g. 2.0 plays the trajectory at half the speed). The
+  // trajectory can only be started when the motor is stationary, otherwise
+  // the method returns false. Don't call other methods that move the motor
+  // while the trajectory is playing.
+  bool playTrajectory(const StepTrajectory& trajectory, bool reverse = false,
+                      float time_scale = 1.0);
+
+  // Returns true if a trajectory is currently playing.
+  bool isPlaying();
+
+  // Enables the load governor. The time spent in the step interrupts of all
+  // the steppers is measured over windows of `window` μs. If it exceeds the
+  // `budget` (a fraction of the CPU time, e.g. 0.5) all the steppers are
+  // slowed down by the same factor, which keeps the moves of multiple
+  // steppers coordinated, and sped up again once the load drops. A budget of
+  // 0 disables the governor.
+  static void setLoadBudget(float budget, uint32_t window = 10000);
+
+  // Returns the fraction of the CPU time spent in the step interrupts during
+  // the last window.
+  static float interruptLoad();
+
+  // Returns the fraction of the full speed the load governor currently lets
+  // the steppers run at (1.0 if there is no overload).
+  static float loadSpeedScale();
+
+  // Scales the speed of all the steppers by `factor` (0.1 to 2.0, i.e. 10%
+  // to 200%) without replanning their moves: the step intervals are divided
+  // by the factor, while the speed profiles stay the same. The factor is
+  // ramped to the new value as fast as the acceleration of the steppers
+  // allows at their max speed.
+  static void setFeedOverride(float factor);
+  // Returns the feed override factor the steppers are ramping to.
+  static float feedOverride();
+
+  // Sets the priority (0 - highest to 15 - lowest) of the stepper's timer
+  // interrupt. A step interrupt can only be delayed by interrupts with the
+  // same or a higher priority (lower value). Only works for the globally
+  // defined timers (`Timer0` to `Timer8`).
+  void setInterruptPriority(uint8_t priority);
+
+  // Returns the priority of the stepper's timer interrupt.
+  uint8_t interruptPriority();
+
+  // Assigns interrupt priorities to all existing steppers following the
+  // recommended scheme: the higher the max speed of a stepper, the higher its
+  // priority, so that fast steppers preempt the interrupts of slow ones.
+  // The priorities start at `highest` and steppers with equal max speeds
+  // share the same priority. Priority 0 is left to the emergency stop and
+  // other pin interrupts by default.
+  static void assignInterruptPriorities(uint8_t highest = 1);
+
+  // Returns the largest difference (in μs) between the time a step
+  // interrupt was scheduled for and the time it actually started, measured
+  // since the last call to `resetStepJitter()`.
+  uint32_t maxStepJitter();
+  // Resets the step jitter measurement.
+  void resetStepJitter();
+
+  // Sets what to do when a step can't be scheduled on time. With
+  // `LATENESS_FAULT` the motor is stopped once the lateness accumulated
+  // during the current move exceeds `fault_threshold` μs.
+  void setLatenessPolicy(LatenessPolicy policy, uint32_t fault_threshold = 1000);
+
+  // Returns the number of steps that were scheduled later than the profile
+  // required.
+  uint32_t missedDeadlines();
+  // Returns the total time (in μs) by which the steps were late.
+  uint32_t totalLateness();
+  // Returns the largest lateness (in μs) of a single step.
+  uint32_t maxLateness();
+  // Returns the lateness (in μs) accumulated during the current move and not
+  // caught up yet.
+  uint32_t moveLateness();
+  // Returns true if the motor was stopped by `LATENESS_FAULT`.
+  bool latenessFault();
+  // Resets the lateness counters and the fault flag.
+  void resetLatenessCounters();
+
+  // Starts the fixed-rate velocity loop. `timer` interrupts `frequency` times
+  // per second with the given `priority` (the lowest by default, so that the
+  // step interrupts can preempt it) and recomputes the speed of every stepper
+  // in the velocity mode.
+  static void startVelocityLoop(PrecDueTimer& timer, float frequency = 1000,
+                                uint8_t priority = 15);
+  // Stops the fixed-rate velocity loop.
+  static void stopVelocityLoop();
+
+  // Switches the stepper between computing its speed profile in every step
+  // interrupt (the default) and the velocity mode, in which the velocity loop
+  // updates the speed at a fixed rate and the step interrupt only makes steps
+  // at that speed. Can only be changed while the motor is stationary, and
+  // not during a feed hold of its group. Returns false otherwise.
+  bool setVelocityMode(bool enable);
+  // Returns true if the stepper is in the velocity mode.
+  bool velocityMode();
+
+  // Shapes the speed computed by the velocity loop with the input shaper to
+  // cancel a resonance of the machine (NULL turns the shaping off). Only
+  // used in the velocity mode. Can only be changed while the motor is
+  // stationary and the shaper must fit into its history at the rate of the
+  // velocity loop. Returns false otherwise.
+  bool setInputShaper(InputShaper* shaper);
+  // Returns the input shaper of the stepper, or NULL if there's none.
+  InputShaper* inputShaper();
+
+  // Moves the outputs of the stepper from its pins to `bits` consecutive
+  // outputs of the shift register chain starting from `first_bit` (step and
+  // direction for a driver). The chain is updated by the step engine, so the
+  // stepper must be attached to an engine whose output is the chain. Returns
+  // false otherwise.
+  bool setShiftOutput(ShiftOutput& output, uint8_t first_bit, uint8_t bits = 2);
+
+  // Overridden from the AccelStepper class so that the pins aren't
+  // configured when the outputs are on a shift register chain.
+  void enableOutputs() override;
+
+  // Hide the AccelStepper methods to keep track of the inverted step and
+  // direction pins, which the step engine writes directly.
+  void setPinsInverted(bool directionInvert = false, bool stepInvert = false, 
+                       bool enableInvert = false);
+  void setPinsInverted(bool pin1Invert, bool pin2Invert, bool pin3Invert, 
+                       bool pin4Invert, bool enableInvert);
+  // Hides the AccelStepper method to keep track of the pulse width of the
+  // step pin written directly. With a step engine the pulse lasts one tick,
+  // so widths longer than the tick period are ignored.
+  void setMinPulseWidth(unsigned int minWidth);
+
+  // Sets the time (in μs) between changing the direction pin and the next
+  // step pulse with the `DRIVER` interface. The step is delayed by starting
+  // the timer with the setup time, or with a step engine by as many ticks as
+  // the setup time takes. The direction pin is only written when the
+  // direction changes.
+  void setDirectionSetupTime(uint16_t setup_time);
+  // Returns the direction setup time in μs.
+  uint16_t directionSetupTime();
+
+  // Sets the backlash (in steps) of the mechanics driven by the stepper and
+  // the speed (in steps/s) at which it is taken up. After every change of
+  // direction, the step interrupt makes `steps` extra pulses before the first
+  // step in the new direction, without changing the position. The rest of
+  // the move is delayed by the takeup. Only used with the `DRIVER` interface
+  // and without a step engine.
+  void setBacklash(uint16_t steps, float speed = 1000.0);
+  // Returns the backlash in steps.
+  uint16_t backlash();
+
   // Method overridden from the AccelStepper library to make sure that it
   // doesn't interfere with the motor when the user accidentally calls this
   // method.
   bool run();
 
+  // Hides the AccelStepper method to also report a step that is still
+  // delayed by a change of direction (and the backlash takeup before it)
+  // after the move reached its target.
+  bool isRunning();
+
   // Below are methods overriden from the AccelStepper library that need to
   // stop currently scheduled interrupts before doing their own calculations
   // so that no race conditions occur.
@@ -79,20 +399,336 @@ protected:
   // Method which is called every step and returns the time period (in μs)
   // to wait until the next step should occur. If the method returns 0, that 
   // means that the engine should stop.
-  virtual uint32_t getNextInterval();
+  INTERRUPT_STEPPER_RAMFUNC virtual uint32_t getNextInterval();
 
   // Method overriden from the `AccelStepper` class to allow the use of the
   // interrupt capabilities of this class. This method calculates how much
   // time to wait until the next step is due.
-  uint32_t computeNewSpeed() override;
+  INTERRUPT_STEPPER_RAMFUNC uint32_t computeNewSpeed() override;
+
+  // Overridden from the AccelStepper class so that with a step engine the
+  // step pulse is ended by the engine's next tick instead of a busy wait.
+  INTERRUPT_STEPPER_RAMFUNC void step1(long step) override;
+
+  // Overridden from the AccelStepper class to write the outputs to the shift
+  // register chain if the stepper uses one.
+  INTERRUPT_STEPPER_RAMFUNC void setOutputPins(uint8_t mask) override;
 
 private:
+  // Stops the timer, or the engine if the stepper is attached to one
+  INTERRUPT_STEPPER_RAMFUNC void stopTimer();
+  // Ends the step pulse started by `step1()`
+  INTERRUPT_STEPPER_RAMFUNC void endStepPulse();
+  // Makes the step pulse of the `DRIVER` interface on the step pin, or on the
+  // shift register output or the pins written by the engine
+  INTERRUPT_STEPPER_RAMFUNC void stepPulse();
+  // Makes the next pulse of the step delayed by a change of direction: a
+  // takeup pulse of the backlash, or the step itself. Returns the time (in
+  // μs) until the next pulse, or 0 once the step is made.
+  INTERRUPT_STEPPER_RAMFUNC uint32_t deferredPulse();
+  // Gives up the step delayed by a change of direction when the stepper is
+  // stopped before it is made. The position goes back by the step, and the
+  // takeup pulses still owed are made before the next step.
+  INTERRUPT_STEPPER_RAMFUNC void dropDeferredStep();
+  // Makes the step delayed by a change of direction go on with a step after
+  // `interval` (or stop if it is 0) once the move was replanned. Must not
+  // be interrupted by the stepper's timer. Returns the time (in μs) the timer has
+  // to be started with for the next deferred pulse.
+  INTERRUPT_STEPPER_RAMFUNC uint32_t continueDeferredStep(uint32_t interval);
+  // Stops the timer once the target was reached and starts whatever follows
+  // the move
+  INTERRUPT_STEPPER_RAMFUNC void moveFinished();
+  // Switches the microstep resolution if the motor is on a full step position
+  // and the switching conditions are met
+  INTERRUPT_STEPPER_RAMFUNC void updateMicrostepping();
+  // Switches back to the fine resolution. Between the pulses the motor is
+  // always on a coarse step, which it passes through at both resolutions.
+  INTERRUPT_STEPPER_RAMFUNC void fineMicrostepping();
+  // Switches back to the fine resolution if a new target is too close for
+  // the coarse pulses, or behind the motor
+  INTERRUPT_STEPPER_RAMFUNC void checkCoarseTarget();
+  // Writes the microstep resolution `mask` to the MS pins
+  INTERRUPT_STEPPER_RAMFUNC void writeMicrostepPins(uint8_t mask);
+  // Compares the encoder position with the current position. Returns false
+  // if the motor should stop.
+  INTERRUPT_STEPPER_RAMFUNC bool checkEncoder();
+  // Converts an encoder count to a position in steps
+  INTERRUPT_STEPPER_RAMFUNC long encoderToSteps(int32_t count);
+  // Stops the motor immediately at the current position
+  INTERRUPT_STEPPER_RAMFUNC void halt();
+  // Moves to the next homing phase after the endstop got triggered
+  void homingTriggered();
+  // Moves to the next homing phase after the target position was reached
+  void homingTargetReached();
+  // Handles the emergency stop in the interrupt. Returns false if the motor
+  // should not step anymore.
+  INTERRUPT_STEPPER_RAMFUNC bool emergencyStep();
+  // Interrupt attached to the emergency stop pin
+  static void emergencyStopInterrupt();
+  // Measures the load of the last window and adjusts the speed scale
+  INTERRUPT_STEPPER_RAMFUNC static void updateLoadGovernor(uint32_t now);
+  // Returns the feed override (16.16 fixed point) at the time `now` of the
+  // ramp towards the new override
+  INTERRUPT_STEPPER_RAMFUNC static uint32_t currentFeedOverride(uint32_t now);
+  // Returns the speed factor (16.16 fixed point) of the load governor at the
+  // time `now` of its ramp
+  INTERRUPT_STEPPER_RAMFUNC static uint32_t currentLoadSpeed(uint32_t now);
+  // Starts ramping the speed factor of the load governor towards `target`
+  // (16.16 fixed point). Must be called with interrupts disabled.
+  INTERRUPT_STEPPER_RAMFUNC static void rampLoadSpeed(uint32_t target, 
+                                                      uint32_t now);
+  // Returns the factor (16.16 fixed point) multiplying the step intervals
+  // for the load governor at the time `now`
+  INTERRUPT_STEPPER_RAMFUNC static uint32_t loadScale(uint32_t now);
+  // Returns the value at the time `now` of a ramp from `from` to `to`
+  // started at `start` with the rate `rate` (per 2^20 μs)
+  INTERRUPT_STEPPER_RAMFUNC static uint32_t rampValue(uint32_t from, 
+                  uint32_t to, uint32_t start, uint32_t rate, uint32_t now);
+  // Returns the fastest change (per second) of a factor of all the speeds
+  // that keeps every stepper within its acceleration, even at its max
+  // speed (0 if no stepper limits it)
+  INTERRUPT_STEPPER_RAMFUNC static float speedRampRate();
+  // Converts the rate from `speedRampRate()` into 16.16 units per 2^20 μs
+  INTERRUPT_STEPPER_RAMFUNC static uint32_t fixedRampRate(float rate);
+  // Returns the factor (16.16 fixed point) multiplying the step intervals
+  // for the feed override at the time `now`
+  INTERRUPT_STEPPER_RAMFUNC static uint32_t feedScale(uint32_t now);
+  // Scales the interval (in μs) by the load governor and the feed override
+  // at the time `now`. Every interval that is scheduled goes through it.
+  INTERRUPT_STEPPER_RAMFUNC static uint32_t scaleInterval(uint32_t interval,
+                                                          uint32_t now);
+  // Returns the interrupt number of the timer, or -1 if it's not one of the
+  // globally defined timers
+  static int timerIRQn(PrecDueTimer& timer);
+  // Shortens `_next_interval` to catch up on the lateness of the move
+  INTERRUPT_STEPPER_RAMFUNC void catchUp();
+  // Accounts for the lateness if the next step can't be scheduled on time.
+  // Returns the lateness in μs.
+  INTERRUPT_STEPPER_RAMFUNC uint32_t checkDeadline();
+  // Returns the interval until the next step of the playing trajectory, or 0
+  // when the trajectory is finished
+  INTERRUPT_STEPPER_RAMFUNC uint32_t nextTrajectoryInterval();
+  // Returns the interval of the next step in the velocity mode, or 0 if the
+  // motor should stop
+  INTERRUPT_STEPPER_RAMFUNC uint32_t velocityInterval();
+  // Interrupt function of the velocity loop
+  static void velocityLoopInterrupt();
+  // Recomputes the speed of the stepper in the velocity mode, `dt` seconds
+  // after the previous update
+  void velocityUpdate(float dt);
+  // Returns the speed after `dt` seconds of moving at the speed `v` towards
+  // a target `distance` steps away, within the acceleration and max speed
+  float plannedSpeed(float v, long distance, float dt);
+  // Returns the shaped speed of the reference motion towards the target.
+  // Falls back to the unshaped speed once the shaped motion is over.
+  float shapedSpeed(float v, long distance, float dt);
+  // Clears the shaper's history and the reference motion
+  void resetShaping();
+  // Makes a single step forward or backward for the arc interpolator
+  INTERRUPT_STEPPER_RAMFUNC void arcStep(bool forward);
+
+  // Emergency stop states of a single stepper
+  enum EmergencyState {
+    ESTOP_NONE,
+    ESTOP_HALT,
+    ESTOP_DECEL_REQUEST,
+    ESTOP_DECELERATING
+  };
+
+  friend class StepperGroup;
+  friend class StepEngine;
+  friend class ArcInterpolator;
+
+  // The group this stepper belongs to (NULL if none) and its index in it
+  StepperGroup* _group = NULL;
+  uint8_t _group_index;
+
+  // The engine making the steps of this stepper (NULL if it uses its own
+  // timer) and its index in it
+  StepEngine* _engine = NULL;
+  uint8_t _engine_index;
+
+  // The shift register chain holding the outputs (NULL if the pins are
+  // used), the first output and the number of outputs
+  ShiftOutput* _shift_output = NULL;
+  uint8_t _shift_bit;
+  uint8_t _shift_bits;
+
+  // Step and direction pins of the `DRIVER` interface as PIO port and mask,
+  // written directly by the step engine. The port is given as its index
+  // (0 - PIOA to 3 - PIOD), or `NO_STEP_PORT` with other interfaces.
+  uint8_t _step_port;
+  Pio* _step_pio;
+  uint32_t _step_mask;
+  bool _step_inverted = false;
+  Pio* _dir_port;
+  uint32_t _dir_mask;
+  bool _dir_inverted = false;
+  // Last direction written to the direction pin (-1 if unknown)
+  int8_t _dir_level = -1;
+  // Direction setup time and step pulse width (in μs)
+  uint16_t _dir_setup = 1;
+  uint16_t _pulse_width = 1;
+  // Whether the step of the current interrupt waits for the direction setup
+  // time to pass
+  volatile bool _step_deferred = false;
+  // Whether the move ends with the deferred step
+  volatile bool _stop_deferred = false;
+  // Backlash, interval (in μs) of its takeup pulses and the number of
+  // takeup pulses still to be made before the deferred step
+  uint16_t _backlash = 0;
+  uint32_t _takeup_interval = 1000;
+  volatile uint16_t _takeup = 0;
+  // Direction the mechanics last moved in (-1 if unknown). Unlike
+  // `_dir_level` it isn't reset when the direction pin is written again.
+  int8_t _backlash_dir = -1;
+
+  // All existing steppers form a linked list so that they can be stopped
+  // together
+  static InterruptStepper* _first_stepper;
+  InterruptStepper* _next_stepper;
+
   // Time at which the last step occured
   uint32_t _start_time = 0;
   // How long the step itself took
   uint32_t _step_time;
   // The interval until the next step is due
   uint32_t _next_interval;
+
+  // Pins connected to the MS1, MS2 and MS3 driver inputs (0xff if not used)
+  uint8_t _ms_pins[3] = {0xff, 0xff, 0xff};
+  // Speed (in fine microsteps/s) above which the coarse resolution is used
+  float _ms_threshold = 0.0;
+  // Number of fine microsteps in a full step
+  uint8_t _ms_fine = 1;
+  // Number of fine microsteps in a single coarse microstep (1 if disabled)
+  uint8_t _ms_ratio = 1;
+  // MS pin states for the fine and coarse resolutions
+  uint8_t _ms_fine_mask = 0;
+  uint8_t _ms_coarse_mask = 0;
+  // Whether the driver is currently running at the coarse resolution
+  bool _ms_coarse = false;
+
+  // Encoder used for closed loop monitoring (NULL if not used)
+  QuadratureEncoder* _encoder = NULL;
+  // Steps per encoder count in 32.32 fixed point
+  int64_t _enc_scale;
+  // Position (in steps) corresponding to the encoder count of 0
+  long _enc_offset;
+  // Number of steps between the encoder checks
+  uint16_t _enc_interval;
+  // Number of steps since the last encoder check
+  uint16_t _enc_steps = 0;
+  // Maximum allowed following error (in steps)
+  long _enc_max_error;
+  EncoderMode _enc_mode;
+  // Encoder status flags
+  volatile uint8_t _enc_status = ENCODER_OK;
+  // Following error measured during the last check
+  volatile long _enc_error = 0;
+  // Current and encoder positions during the last check
+  long _enc_last_pos;
+  long _enc_last_enc_pos;
+
+  // Port and bit mask of the endstop pin (NULL port if not used)
+  Pio* _endstop_port = NULL;
+  uint32_t _endstop_mask;
+  // State of the endstop pin when it is triggered
+  bool _endstop_active;
+  volatile HomingState _homing_state = HOMING_IDLE;
+  // Set by `stop()` during homing, which then fails once the motor stops
+  volatile bool _homing_stopped = false;
+  // Homing parameters
+  bool _homing_dir;
+  float _homing_slow_speed;
+  long _homing_backoff;
+  long _homing_position;
+  long _homing_travel;
+  // Max speed to restore once homing is finished
+  float _homing_saved_speed;
+  // Position at which the endstop got triggered during the slow approach
+  volatile long _homing_trigger;
+
+  // Emergency stop input pin (0xff if not attached)
+  static uint8_t _estop_pin;
+  static EmergencyAction _estop_action;
+  static volatile bool _estopped;
+  static volatile uint32_t _estop_time;
+  volatile EmergencyState _estop_state = ESTOP_NONE;
+  // Emergency deceleration (0 means that the stepper is halted instead)
+  float _estop_deceleration = 0.0;
+  // Acceleration to restore after decelerating at the emergency deceleration
+  float _estop_saved_accel;
+
+  // The trajectory being played (NULL if none)
+  const StepTrajectory* volatile _trajectory = NULL;
+  bool _traj_reverse;
+  // Steps left to make
+  uint32_t _traj_remaining;
+  // Index of the next delta to use
+  uint32_t _traj_index;
+  // Current unscaled interval
+  uint32_t _traj_interval;
+  // Time scale in 16.16 fixed point
+  uint32_t _traj_scale;
+
+  // Load governor state shared by all the steppers
+  static float _load_budget;
+  static uint32_t _load_window;
+  static uint32_t _load_window_start;
+  // Time spent in the step interrupts during the current window
+  static volatile uint32_t _load_busy;
+  // Load measured during the last window
+  static volatile float _load;
+  // Speed factor ramp of the governor (16.16 fixed point), like the feed
+  // override ramp below
+  static volatile uint32_t _load_from;
+  static volatile uint32_t _load_to;
+  static volatile uint32_t _load_ramp_start;
+  static volatile uint32_t _load_rate;
+  // Factor (16.16 fixed point) multiplying all the step intervals once the
+  // ramp is over
+  static volatile uint32_t _load_scale;
+
+  // Feed override ramp (16.16 fixed point): the override at the start of
+  // the ramp, its target, the time the ramp started and its rate (per 2^20
+  // μs). The ramp is over once the start equals the target.
+  static volatile uint32_t _feed_from;
+  static volatile uint32_t _feed_to;
+  static volatile uint32_t _feed_ramp_start;
+  static volatile uint32_t _feed_rate;
+  // Factor multiplying the step intervals once the ramp is over
+  static volatile uint32_t _feed_scale;
+
+  // Time at which the next step interrupt is scheduled
+  uint32_t _next_step_time;
+  // Whether `_next_step_time` was set by the previous step interrupt
+  bool _jitter_armed = false;
+  volatile uint32_t _max_jitter = 0;
+
+  LatenessPolicy _lateness_policy = LATENESS_ABSORB;
+  uint32_t _lateness_threshold = 1000;
+  volatile uint32_t _missed_deadlines = 0;
+  volatile uint32_t _total_lateness = 0;
+  volatile uint32_t _max_lateness = 0;
+  // Lateness of the current move, cleared when the motor stops
+  volatile uint32_t _move_lateness = 0;
+  volatile bool _lateness_fault = false;
+
+  // Timer of the velocity loop and the time between its updates (in s)
+  static PrecDueTimer* _velocity_timer;
+  static float _velocity_dt;
+  bool _velocity_mode = false;
+  // Whether the timer is running in the velocity mode
+  volatile bool _velocity_stepping = false;
+  // Time at which the period until the next step started
+  uint32_t _period_start;
+
+  // Input shaper of the velocity mode (NULL if none), and the position and
+  // speed of the unshaped reference motion
+  InputShaper* _shaper = NULL;
+  float _ref_position = 0.0;
+  float _ref_speed = 0.0;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+/*
+  InterruptStepperConfig.h - Build options of the InterruptStepper library.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef INTERRUPT_STEPPER_CONFIG_H
+#define INTERRUPT_STEPPER_CONFIG_H
+
+// Uncomment (or define in the build flags) to run the step interrupts from
+// RAM instead of flash, which is read with wait states. See "Running the step
+// interrupts from RAM" in the README.
+// #define INTERRUPT_STEPPER_RUN_FROM_RAM
+
+#ifdef INTERRUPT_STEPPER_RUN_FROM_RAM
+// Places a function in the `.ramfunc` section, which the Due's startup code
+// copies to RAM together with the initialized variables. RAM is too far from
+// flash for a direct branch, so the function must be called with `long_call`.
+#define INTERRUPT_STEPPER_RAMFUNC \
+  __attribute__((section(".ramfunc"), noinline, long_call))
+#else
+#define INTERRUPT_STEPPER_RAMFUNC
+#endif
+
+#endif
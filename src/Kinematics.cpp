@@ -0,0 +1,103 @@
+/*
+  Kinematics.cpp - Maps moves of the Cartesian axes of a machine to the moves
+  of the motors of a StepperGroup.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "Kinematics.h"
+
+Kinematics::Kinematics(StepperGroup& group, uint8_t axes)
+  : _group(group), _axes(axes > KINEMATICS_MAX_AXES ? KINEMATICS_MAX_AXES : axes) {}
+
+uint8_t Kinematics::axes() {
+  return _axes;
+}
+
+bool Kinematics::queueMove(const long targets[], float speed, float acceleration) {
+  long start[KINEMATICS_MAX_AXES];
+  targetPosition(start);
+
+  long motor_start[STEPPER_GROUP_MAX_STEPPERS];
+  long motor_targets[STEPPER_GROUP_MAX_STEPPERS];
+  toMotors(start, motor_start);
+  toMotors(targets, motor_targets);
+
+  // Length of the line and the distance of the motor moving the furthest
+  float length = 0.0;
+  for (uint8_t i = 0; i < _axes; i++) {
+    float distance = targets[i] - start[i];
+    length += distance * distance;
+  }
+  length = sqrt(length);
+  long longest = 0;
+  for (uint8_t i = 0; i < _group.size(); i++) {
+    long distance = labs(motor_targets[i] - motor_start[i]);
+    if (distance > longest)
+      longest = distance;
+  }
+  if (longest == 0)
+    return true;
+
+  // The group applies the speed and acceleration to the motor moving the
+  // furthest, which covers `longest / length` steps per step of the line
+  float ratio = length > 0.0 ? longest / length : 1.0;
+  return _group.queueMove(motor_targets, speed * ratio, acceleration * ratio);
+}
+
+void Kinematics::currentPosition(long positions[]) {
+  long motors[STEPPER_GROUP_MAX_STEPPERS];
+  noInterrupts();
+  for (uint8_t i = 0; i < _group.size(); i++)
+    motors[i] = _group._steppers[i]->currentPosition();
+  interrupts();
+  toAxes(motors, positions);
+}
+
+void Kinematics::targetPosition(long targets[]) {
+  toAxes(_group._last_targets, targets);
+}
+
+CoreXYKinematics::CoreXYKinematics(StepperGroup& group)
+  : Kinematics(group, group.size()) {}
+
+void CoreXYKinematics::toMotors(const long axes[], long motors[]) {
+  motors[0] = axes[0] + axes[1];
+  motors[1] = axes[0] - axes[1];
+  for (uint8_t i = 2; i < _axes; i++)
+    motors[i] = axes[i];
+}
+
+void CoreXYKinematics::toAxes(const long motors[], long axes[]) {
+  // A + B is always even at the positions computed by `toMotors()`, the
+  // rounding only matters while the motors are between two of them
+  axes[0] = (motors[0] + motors[1]) / 2;
+  axes[1] = (motors[0] - motors[1]) / 2;
+  for (uint8_t i = 2; i < _axes; i++)
+    axes[i] = motors[i];
+}
+
+DualMotorKinematics::DualMotorKinematics(StepperGroup& group, 
+                                         const uint8_t motor_axes[])
+  : Kinematics(group, 0) {
+  for (uint8_t i = 0; i < group.size(); i++) {
+    _motor_axes[i] = motor_axes[i];
+    if (motor_axes[i] + 1 > _axes)
+      _axes = motor_axes[i] + 1;
+  }
+  if (_axes > KINEMATICS_MAX_AXES)
+    _axes = KINEMATICS_MAX_AXES;
+}
+
+void DualMotorKinematics::toMotors(const long axes[], long motors[]) {
+  for (uint8_t i = 0; i < _group.size(); i++)
+    motors[i] = axes[_motor_axes[i]];
+}
+
+void DualMotorKinematics::toAxes(const long motors[], long axes[]) {
+  for (uint8_t i = _group.size(); i > 0; i--)
+    axes[_motor_axes[i - 1]] = motors[i - 1];
+}
@@ -0,0 +1,88 @@
+/*
+  Kinematics.h - Maps moves of the Cartesian axes of a machine to the moves
+  of the motors of a StepperGroup.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include "StepperGroup.h"
+
+// Maximum number of Cartesian axes
+#define KINEMATICS_MAX_AXES STEPPER_GROUP_MAX_STEPPERS
+
+// Queues the moves of the Cartesian axes as coordinated moves of the motors
+// of a group. The positions of the axes are in steps, like those of the
+// motors. The transform is only used when a move is queued: the group moves
+// all the motors along proportional speed profiles, so a straight line of
+// the axes stays straight for any linear kinematics, and the step interrupts
+// don't depend on the kinematics at all.
+//
+// Other kinematics are added by deriving from this class and implementing
+// `toMotors()` and `toAxes()`.
+class Kinematics {
+public:
+  // Takes the group of the motors, which must already contain all of them,
+  // and the number of Cartesian axes.
+  Kinematics(StepperGroup& group, uint8_t axes);
+
+  // Returns the number of Cartesian axes.
+  uint8_t axes();
+
+  // Queues a straight move of the axes to the absolute `targets` (one for
+  // each axis). `speed` (steps/s) and `acceleration` (steps/s^2) are those
+  // of the tool along the line. Returns false if the queue of the group is
+  // full.
+  bool queueMove(const long targets[], float speed, float acceleration);
+
+  // Gets the current positions of the axes.
+  void currentPosition(long positions[]);
+  // Gets the positions of the axes at the end of the last queued move.
+  void targetPosition(long targets[]);
+
+  // Computes the positions of the motors (in the order they were added to
+  // the group) from the positions of the axes.
+  virtual void toMotors(const long axes[], long motors[]) = 0;
+  // Computes the positions of the axes from the positions of the motors.
+  virtual void toAxes(const long motors[], long axes[]) = 0;
+
+  virtual ~Kinematics() {}
+
+protected:
+  StepperGroup& _group;
+  uint8_t _axes;
+};
+
+// CoreXY and H-bot machines, where X and Y are moved by two motors together:
+// A = X + Y and B = X - Y. The first two motors of the group are A and B,
+// any further motors move the further axes (Z...) directly. Swap the motors
+// or invert a direction pin if the machine moves the wrong way.
+class CoreXYKinematics : public Kinematics {
+public:
+  CoreXYKinematics(StepperGroup& group);
+
+  void toMotors(const long axes[], long motors[]) override;
+  void toAxes(const long motors[], long axes[]) override;
+};
+
+// Machines with axes moved by more than one motor, such as a gantry with a
+// motor on each side. `motor_axes` gives the axis moved by each motor of the
+// group, e.g. { 0, 1, 1 } for X moved by the first motor and Y by the other
+// two. The position of an axis is taken from its first motor.
+class DualMotorKinematics : public Kinematics {
+public:
+  DualMotorKinematics(StepperGroup& group, const uint8_t motor_axes[]);
+
+  void toMotors(const long axes[], long motors[]) override;
+  void toAxes(const long motors[], long axes[]) override;
+
+private:
+  uint8_t _motor_axes[STEPPER_GROUP_MAX_STEPPERS];
+};
+
+#endif
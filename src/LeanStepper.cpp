@@ -0,0 +1,241 @@
+/*
+  LeanStepper.cpp - A lightweight interrupt driven stepper with a compact
+  state for running many axes.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "LeanStepper.h"
+
+// Frequency of the timer clock (MCK/2)
+#define LEAN_TICKS_PER_SECOND 42000000.0
+// Minimal number of ticks between the end of the step interrupt and the
+// next compare match
+#define LEAN_MIN_TICKS 84
+
+LeanStepper::LeanStepper(PrecDueTimer& timer, uint8_t step_pin, uint8_t dir_pin)
+  : _timer(timer) {
+  // The timers are consecutive channels of the TC0, TC1 and TC2 counters
+  PrecDueTimer* timers[] = { &Timer0, &Timer1, &Timer2, &Timer3, &Timer4,
+                             &Timer5, &Timer6, &Timer7, &Timer8 };
+  Tc* counters[] = { TC0, TC1, TC2 };
+  // Any other timer has no channel to run the steps with, so the stepper
+  // refuses to move instead of taking over the channel of another timer
+  _state.channel = NULL;
+  for (uint8_t i = 0; i < 9; i++) {
+    if (&timer == timers[i]) {
+      _irq = (IRQn_Type)(TC0_IRQn + i);
+      _state.channel = &counters[i / 3]->TC_CHANNEL[i % 3];
+    }
+  }
+
+  pinMode(step_pin, OUTPUT);
+  pinMode(dir_pin, OUTPUT);
+  _state.step_port = g_APinDescription[step_pin].pPort;
+  _state.step_mask = g_APinDescription[step_pin].ulPin;
+  _state.dir_port = g_APinDescription[dir_pin].pPort;
+  _state.dir_mask = g_APinDescription[dir_pin].ulPin;
+  _state.step_port->PIO_CODR = _state.step_mask;
+
+  _state.position = 0;
+  _state.target = 0;
+  _state.profile.n = 0;
+  _state.profile.cn = 0;
+  _state.direction = 1;
+  _state.pulse_width = 0;
+  _state.running = false;
+  setMaxSpeed(1.0);
+  setAcceleration(1.0);
+}
+
+void LeanStepper::attachInterrupt(void (*isr)()) {
+  _timer.attachInterrupt(isr);
+}
+
+void LeanStepper::detachInterrupt() {
+  _timer.detachInterrupt();
+}
+
+void LeanStepper::stepInterrupt() {
+  LeanStepperState& s = _state;
+
+  s.step_port->PIO_SODR = s.step_mask;
+  s.position += s.direction;
+  // The interval is computed while the step pin is high, so the pulse
+  // doesn't need a busy wait of its own
+  uint32_t interval = nextInterval();
+  if (s.pulse_width)
+    delayMicroseconds(s.pulse_width);
+  s.step_port->PIO_CODR = s.step_mask;
+
+  if (interval == 0) {
+    _timer.stop();
+    s.running = false;
+    return;
+  }
+
+  // The counter restarted from 0 at the compare match that triggered this
+  // interrupt, so the new period is measured from the previous step. If the
+  // interrupt itself took longer, the step is made as soon as possible.
+  uint32_t now = s.channel->TC_CV + LEAN_MIN_TICKS;
+  s.channel->TC_RC = interval > now ? interval : now;
+}
+
+void LeanStepper::moveTo(long absolute) {
+  if (!hasTimer())
+    return;
+  noInterrupts();
+  _state.target = absolute;
+  if (!_state.running) {
+    uint32_t interval = nextInterval();
+    if (interval != 0)
+      startTimer(interval);
+  }
+  interrupts();
+}
+
+void LeanStepper::move(long relative) {
+  moveTo(_state.position + relative);
+}
+
+void LeanStepper::stop() {
+  noInterrupts();
+  if (_state.running) {
+    long steps_to_stop = _state.profile.stepsToStop();
+    _state.target = _state.position + _state.direction * steps_to_stop;
+  }
+  interrupts();
+}
+
+void LeanStepper::setMaxSpeed(float speed) {
+  if (speed <= 0.0)
+    return;
+  _max_speed = speed;
+  float n_max = _acceleration > 0.0 ? speed * speed / (2.0 * _acceleration) : 0;
+  noInterrupts();
+  _state.profile.cmin = LEAN_TICKS_PER_SECOND / speed;
+  _state.profile.setStepsToMaxSpeed(n_max);
+  interrupts();
+}
+
+float LeanStepper::maxSpeed() {
+  return _max_speed;
+}
+
+void LeanStepper::setAcceleration(float acceleration) {
+  if (acceleration <= 0.0 || acceleration == _acceleration)
+    return;
+  noInterrupts();
+  // Keep the current speed, like AccelStepper does
+  if (_acceleration > 0.0)
+    _state.profile.n = _state.profile.n * (_acceleration / acceleration);
+  // Equation 15
+  _state.profile.c0 = 0.676 * sqrt(2.0 / acceleration) * LEAN_TICKS_PER_SECOND;
+  interrupts();
+  _acceleration = acceleration;
+  setMaxSpeed(_max_speed);
+}
+
+float LeanStepper::acceleration() {
+  return _acceleration;
+}
+
+float LeanStepper::speed() {
+  noInterrupts();
+  bool running = _state.running;
+  uint32_t cn = _state.profile.cn;
+  int8_t direction = _state.direction;
+  interrupts();
+  return running && cn ? direction * LEAN_TICKS_PER_SECOND / cn : 0.0;
+}
+
+long LeanStepper::distanceToGo() {
+  noInterrupts();
+  long distance = _state.target - _state.position;
+  interrupts();
+  return distance;
+}
+
+long LeanStepper::targetPosition() {
+  return _state.target;
+}
+
+long LeanStepper::currentPosition() {
+  return _state.position;
+}
+
+void LeanStepper::setCurrentPosition(long position) {
+  noInterrupts();
+  _timer.stop();
+  _state.running = false;
+  _state.position = position;
+  _state.target = position;
+  _state.profile.n = 0;
+  interrupts();
+}
+
+bool LeanStepper::isRunning() {
+  return _state.running;
+}
+
+bool LeanStepper::hasTimer() {
+  return _state.channel != NULL;
+}
+
+void LeanStepper::setMinPulseWidth(uint8_t width) {
+  _state.pulse_width = width;
+}
+
+uint32_t LeanStepper::nextInterval() {
+  LeanStepperState& s = _state;
+  StepProfile& p = s.profile;
+  int32_t distance = s.target - s.position;
+  int32_t steps_to_stop = p.stepsToStop();
+
+  if (distance == 0 && steps_to_stop <= 1) {
+    p.n = 0;
+    return 0;
+  }
+
+  int32_t remaining = distance < 0 ? -distance : distance;
+  bool wrong_way = distance == 0 || (distance > 0) != (s.direction > 0);
+  if (p.n > 0) {
+    // Start decelerating if the target is too close, behind the motor or if
+    // the max speed was lowered
+    if (steps_to_stop >= remaining || wrong_way || p.n > p.n_max)
+      p.n = -p.n;
+  } else if (p.n < 0) {
+    // Accelerate again if there's enough room
+    if (steps_to_stop < remaining && !wrong_way && steps_to_stop < p.n_max)
+      p.n = -p.n;
+  }
+
+  if (p.n == 0) {
+    // First step of a move, possibly in the other direction
+    s.direction = distance > 0 ? 1 : -1;
+    if (s.direction > 0)
+      s.dir_port->PIO_SODR = s.dir_mask;
+    else
+      s.dir_port->PIO_CODR = s.dir_mask;
+  }
+  return p.nextInterval();
+}
+
+void LeanStepper::startTimer(uint32_t ticks) {
+  pmc_set_writeprotect(false);
+  pmc_enable_periph_clk(_irq);
+  // Waveform mode, counting up to RC and restarting from 0 at the match
+  _state.channel->TC_CCR = TC_CCR_CLKDIS;
+  _state.channel->TC_CMR = TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC
+                           | TC_CMR_TCCLKS_TIMER_CLOCK1;
+  _state.channel->TC_RC = ticks;
+  _state.channel->TC_IER = TC_IER_CPCS;
+  _state.channel->TC_IDR = ~TC_IER_CPCS;
+  _state.running = true;
+  NVIC_ClearPendingIRQ(_irq);
+  NVIC_EnableIRQ(_irq);
+  _state.channel->TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+}
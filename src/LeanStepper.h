@@ -0,0 +1,107 @@
+/*
+  LeanStepper.h - A lightweight interrupt driven stepper with a compact state
+  for running many axes.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef LEAN_STEPPER_H
+#define LEAN_STEPPER_H
+
+#include <Arduino.h>
+#include <PrecDueTimer.h>
+#include "InterruptStepperConfig.h"
+#include "StepProfile.h"
+
+// Everything the step interrupt reads and writes, packed together so that
+// a step touches only these few consecutive words. All the intervals are in
+// ticks of the timer clock (MCK/2, 42 ticks per μs).
+struct LeanStepperState {
+  // Timer channel whose RC register sets the period until the next step
+  TcChannel* channel;
+  Pio* step_port;
+  uint32_t step_mask;
+  Pio* dir_port;
+  uint32_t dir_mask;
+  int32_t position;
+  int32_t target;
+  StepProfile profile;
+  // 1 - forward, -1 - backward
+  int8_t direction;
+  // Additional width (in μs) of the step pulse
+  uint8_t pulse_width;
+  volatile bool running;
+} __attribute__((aligned(8)));
+
+// A stepper driven by a step/dir driver that keeps only the state needed to
+// run an accelerated move. Unlike InterruptStepper it doesn't derive from
+// AccelStepper: the speed profile (AccelStepper's Equation 13) is computed
+// in integer timer ticks, the pins are written directly to the PIO
+// registers and the timer's period is changed in place instead of
+// restarting the timer every step. Microstep switching, encoders, homing,
+// emergency stop, groups and the other InterruptStepper features are not
+// available.
+//
+// The methods below are named after their AccelStepper counterparts, so
+// code written for InterruptStepper that only uses the basic motion methods
+// can switch to LeanStepper without changes.
+class LeanStepper {
+public:
+  // Takes one of the globally defined timers (`Timer0` to `Timer8`) and the
+  // step and direction pins of the driver. With any other timer the stepper
+  // never moves and `hasTimer()` returns false.
+  LeanStepper(PrecDueTimer& timer, uint8_t step_pin, uint8_t dir_pin);
+
+  // Attaches the interrupt function that must call `stepInterrupt()`:
+  // stepper.attachInterrupt([](){ stepper.stepInterrupt(); });
+  void attachInterrupt(void (*isr)());
+  void detachInterrupt();
+
+  // Makes a step and schedules the next one. Must be called from the
+  // timer's interrupt.
+  INTERRUPT_STEPPER_RAMFUNC void stepInterrupt();
+
+  void moveTo(long absolute);
+  void move(long relative);
+  // Decelerates to a stop as quickly as the acceleration allows.
+  void stop();
+  void setMaxSpeed(float speed);
+  float maxSpeed();
+  void setAcceleration(float acceleration);
+  float acceleration();
+  // Returns the current speed in steps per second (negative when moving
+  // backward).
+  float speed();
+  long distanceToGo();
+  long targetPosition();
+  long currentPosition();
+  // Stops the motor immediately and sets the current and target position.
+  void setCurrentPosition(long position);
+  bool isRunning();
+  // Returns false if the timer passed to the constructor isn't one of the
+  // globally defined timers, so the stepper can't move.
+  bool hasTimer();
+  // Sets an additional width (in μs) of the step pulse. The pulse always
+  // lasts at least as long as computing the next interval.
+  void setMinPulseWidth(uint8_t width);
+
+private:
+  // Computes the interval (in ticks) until the next step and updates the
+  // direction. Returns 0 if the motor should stop.
+  INTERRUPT_STEPPER_RAMFUNC uint32_t nextInterval();
+  // Starts the timer with the first period of a move
+  void startTimer(uint32_t ticks);
+
+  LeanStepperState _state;
+
+  // Configuration only used outside of the step interrupt
+  PrecDueTimer& _timer;
+  IRQn_Type _irq;
+  float _max_speed = 1.0;
+  float _acceleration = 0.0;
+};
+
+#endif
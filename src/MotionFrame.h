@@ -0,0 +1,123 @@
+/*
+  MotionFrame.h - Framing of the binary motion command protocol. This file
+  doesn't depend on Arduino, so it can also be used by the host that sends
+  the commands.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef MOTION_FRAME_H
+#define MOTION_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// A command frame looks as follows (multi-byte values are little endian):
+//   0xA5 | sequence (1) | payload length (1) | payload | CRC-16 (2)
+// The payload consists of any number of commands:
+//   MOTION_CMD_SPEED | speed (float)
+//   MOTION_CMD_ACCEL | acceleration (float)
+//   MOTION_CMD_MOVE  | stepper count (1) | target of each stepper (int32_t)
+// Speed and acceleration apply to all the following moves. Every frame is
+// answered with an acknowledgement:
+//   0x5A | sequence (1) | MotionStatus (1) | queue space (1) | CRC-16 (2)
+// The CRC (CRC-16/CCITT-FALSE) covers everything but the start byte.
+
+#define MOTION_FRAME_START 0xA5
+#define MOTION_ACK_START 0x5A
+// Maximum length of the payload of a single frame
+#define MOTION_MAX_PAYLOAD 255
+// Maximum length of a whole frame
+#define MOTION_MAX_FRAME (MOTION_MAX_PAYLOAD + 5)
+// Length of an acknowledgement
+#define MOTION_ACK_LENGTH 6
+
+enum MotionCommand {
+  MOTION_CMD_SPEED = 0x01,
+  MOTION_CMD_ACCEL = 0x02,
+  MOTION_CMD_MOVE  = 0x03
+};
+
+enum MotionStatus {
+  MOTION_OK          = 0x00, // All commands of the frame were executed
+  MOTION_BAD_CRC     = 0x01, // Frame was corrupted, nothing was executed
+  MOTION_QUEUE_FULL  = 0x02, // Not enough queue space, nothing was executed
+  MOTION_BAD_COMMAND = 0x03  // Unknown or malformed command, or a speed or
+                             // acceleration that isn't positive, nothing executed
+};
+
+// Updates the CRC-16/CCITT-FALSE `crc` with `length` bytes of `data`
+inline uint16_t motionCrc16(const uint8_t* data, size_t length, 
+                            uint16_t crc = 0xFFFF) {
+  while (length--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t i = 0; i < 8; i++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// Builds a command frame in a buffer provided by the caller
+class MotionFrameEncoder {
+public:
+  // `buffer` should be able to hold MOTION_MAX_FRAME bytes
+  MotionFrameEncoder(uint8_t* buffer) : _buffer(buffer), _length(0) {}
+
+  // Starts a new frame with the given sequence number
+  void begin(uint8_t sequence) {
+    _buffer[0] = MOTION_FRAME_START;
+    _buffer[1] = sequence;
+    _buffer[2] = 0;
+    _length = 3;
+  }
+
+  // Each of the below methods appends a command to the frame. They return
+  // false if the command doesn't fit into the frame.
+  bool speed(float speed) { 
+    return putByte(MOTION_CMD_SPEED) && put(&speed, sizeof(speed)); 
+  }
+  bool acceleration(float acceleration) { 
+    return putByte(MOTION_CMD_ACCEL) && put(&acceleration, sizeof(acceleration)); 
+  }
+  bool move(const int32_t* targets, uint8_t count) {
+    if (payloadLength() + 2 + count * sizeof(int32_t) > MOTION_MAX_PAYLOAD)
+      return false;
+    putByte(MOTION_CMD_MOVE);
+    putByte(count);
+    for (uint8_t i = 0; i < count; i++)
+      put(&targets[i], sizeof(int32_t));
+    return true;
+  }
+
+  // Finishes the frame and returns its total length
+  size_t end() {
+    _buffer[2] = (uint8_t)payloadLength();
+    uint16_t crc = motionCrc16(_buffer + 1, _length - 1);
+    _buffer[_length++] = crc & 0xFF;
+    _buffer[_length++] = crc >> 8;
+    return _length;
+  }
+
+private:
+  size_t payloadLength() { return _length - 3; }
+
+  bool putByte(uint8_t value) { return put(&value, 1); }
+
+  bool put(const void* data, size_t length) {
+    if (payloadLength() + length > MOTION_MAX_PAYLOAD)
+      return false;
+    // Both the Arduino Due and the usual hosts are little endian
+    memcpy(_buffer + _length, data, length);
+    _length += length;
+    return true;
+  }
+
+  uint8_t* _buffer;
+  size_t _length;
+};
+
+#endif
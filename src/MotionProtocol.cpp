@@ -0,0 +1,142 @@
+/*
+  MotionProtocol.cpp - Receives binary motion command frames (see MotionFrame.h)
+  and queues the moves in a StepperGroup.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "MotionProtocol.h"
+
+MotionProtocol::MotionProtocol(Stream& stream, StepperGroup& group)
+  : _stream(stream), _group(group) {}
+
+void MotionProtocol::poll() {
+  while (_stream.available() > 0) {
+    uint8_t c = _stream.read();
+
+    switch (_state) {
+      case WAIT_START:
+        if (c == MOTION_FRAME_START) {
+          _received = 0;
+          _state = READ_SEQUENCE;
+        }
+        break;
+
+      case READ_SEQUENCE:
+        _frame[_received++] = c;
+        _state = READ_LENGTH;
+        break;
+
+      case READ_LENGTH:
+        _frame[_received++] = c;
+        // Sequence, length, payload and CRC
+        _length = 2 + c + 2;
+        _state = c > 0 ? READ_PAYLOAD : READ_CRC;
+        break;
+
+      case READ_PAYLOAD:
+        _frame[_received++] = c;
+        if (_received == _length - 2)
+          _state = READ_CRC;
+        break;
+
+      case READ_CRC:
+        _frame[_received++] = c;
+        if (_received == _length) {
+          acknowledge(executeFrame());
+          _state = WAIT_START;
+        }
+        break;
+    }
+  }
+}
+
+uint32_t MotionProtocol::framesExecuted() {
+  return _frames;
+}
+
+uint8_t MotionProtocol::executeFrame() {
+  uint16_t crc = _frame[_length - 2] | (_frame[_length - 1] << 8);
+  if (motionCrc16(_frame, _length - 2) != crc)
+    return MOTION_BAD_CRC;
+
+  uint8_t sequence = _frame[0];
+  if (sequence == _last_sequence)
+    return MOTION_OK;
+
+  const uint8_t* payload = _frame + 2;
+  uint8_t length = _frame[1];
+
+  // Validate the commands and count the moves first, so that a frame is
+  // either executed as a whole or not at all
+  uint8_t moves = 0;
+  for (uint16_t i = 0; i < length; ) {
+    switch (payload[i]) {
+      case MOTION_CMD_SPEED:
+      case MOTION_CMD_ACCEL: {
+        i += 1 + sizeof(float);
+        if (i > length)
+          return MOTION_BAD_COMMAND;
+        // The moves can only be planned with a positive speed and
+        // acceleration
+        float value;
+        memcpy(&value, payload + i - sizeof(float), sizeof(float));
+        if (!isfinite(value) || value <= 0.0)
+          return MOTION_BAD_COMMAND;
+        break;
+      }
+      case MOTION_CMD_MOVE:
+        if (i + 1 >= length || payload[i + 1] != _group.size())
+          return MOTION_BAD_COMMAND;
+        i += 2 + payload[i + 1] * sizeof(int32_t);
+        moves++;
+        break;
+      default:
+        return MOTION_BAD_COMMAND;
+    }
+    if (i > length)
+      return MOTION_BAD_COMMAND;
+  }
+  if (moves > _group.queueSpace())
+    return MOTION_QUEUE_FULL;
+
+  // The values are read straight from the frame, without any allocations
+  for (uint16_t i = 0; i < length; ) {
+    uint8_t command = payload[i++];
+    if (command == MOTION_CMD_SPEED) {
+      memcpy(&_speed, payload + i, sizeof(float));
+      i += sizeof(float);
+    } else if (command == MOTION_CMD_ACCEL) {
+      memcpy(&_acceleration, payload + i, sizeof(float));
+      i += sizeof(float);
+    } else {
+      uint8_t count = payload[i++];
+      long targets[STEPPER_GROUP_MAX_STEPPERS];
+      for (uint8_t j = 0; j < count; j++, i += sizeof(int32_t)) {
+        int32_t target;
+        memcpy(&target, payload + i, sizeof(int32_t));
+        targets[j] = target;
+      }
+      _group.queueMove(targets, _speed, _acceleration);
+    }
+  }
+
+  _last_sequence = sequence;
+  _frames++;
+  return MOTION_OK;
+}
+
+void MotionProtocol::acknowledge(uint8_t status) {
+  uint8_t ack[MOTION_ACK_LENGTH];
+  ack[0] = MOTION_ACK_START;
+  ack[1] = _frame[0];
+  ack[2] = status;
+  ack[3] = _group.queueSpace();
+  uint16_t crc = motionCrc16(ack + 1, 3);
+  ack[4] = crc & 0xFF;
+  ack[5] = crc >> 8;
+  _stream.write(ack, MOTION_ACK_LENGTH);
+}
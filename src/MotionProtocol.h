@@ -0,0 +1,58 @@
+/*
+  MotionProtocol.h - Receives binary motion command frames (see MotionFrame.h)
+  and queues the moves in a StepperGroup.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef MOTION_PROTOCOL_H
+#define MOTION_PROTOCOL_H
+
+#include "StepperGroup.h"
+#include "MotionFrame.h"
+
+class MotionProtocol {
+public:
+  // The constructor takes the stream the frames are received from (e.g. the
+  // native USB port `SerialUSB`) and the group that will execute the moves.
+  MotionProtocol(Stream& stream, StepperGroup& group);
+
+  // Reads and executes the frames waiting in the stream and acknowledges
+  // them. Should be called as often as possible from the main loop.
+  void poll();
+
+  // Returns the number of frames executed so far.
+  uint32_t framesExecuted();
+
+private:
+  // States of the frame decoder
+  enum State { WAIT_START, READ_SEQUENCE, READ_LENGTH, READ_PAYLOAD, READ_CRC };
+
+  // Checks and executes the received frame, returns its MotionStatus
+  uint8_t executeFrame();
+  // Sends the acknowledgement of the received frame
+  void acknowledge(uint8_t status);
+
+  Stream& _stream;
+  StepperGroup& _group;
+
+  State _state = WAIT_START;
+  // The frame being received, without the start byte
+  uint8_t _frame[MOTION_MAX_FRAME];
+  uint16_t _received;
+  uint16_t _length;
+
+  // Sequence number of the last executed frame. A repeated frame (the host
+  // didn't get the acknowledgement) is acknowledged but not executed again.
+  int16_t _last_sequence = -1;
+  // Speed and acceleration of the following moves
+  float _speed = 1000.0;
+  float _acceleration = 1000.0;
+
+  uint32_t _frames = 0;
+};
+
+#endif
@@ -0,0 +1,41 @@
+/*
+  QuadratureEncoder.cpp - Reads a quadrature encoder using the hardware
+  quadrature decoder of the Arduino Due's timer counters.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "QuadratureEncoder.h"
+
+QuadratureEncoder::QuadratureEncoder(Tc* tc, uint8_t filter)
+  : _tc(tc), _filter(filter > 63 ? 63 : filter) {}
+
+void QuadratureEncoder::begin() {
+  // Hand the A and B inputs over to the timer counter (peripheral B)
+  if (_tc == TC2) {
+    pmc_enable_periph_clk(ID_TC6);
+    PIO_Configure(PIOC, PIO_PERIPH_B, PIO_PC25 | PIO_PC26, PIO_DEFAULT);
+  } else {
+    pmc_enable_periph_clk(ID_TC0);
+    PIO_Configure(PIOB, PIO_PERIPH_B, PIO_PB25 | PIO_PB27, PIO_DEFAULT);
+  }
+
+  // Channel 0 counts the position using the XC0 clock driven by the decoder
+  _tc->TC_CHANNEL[0].TC_CMR = TC_CMR_TCCLKS_XC0;
+  _tc->TC_BMR = TC_BMR_QDEN | TC_BMR_POSEN | TC_BMR_EDGPHA 
+                | TC_BMR_MAXFILT(_filter);
+  // Enable the clock and reset the counter
+  _tc->TC_CHANNEL[0].TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+  _offset = 0;
+}
+
+int32_t QuadratureEncoder::read() {
+  return (int32_t)_tc->TC_CHANNEL[0].TC_CV + _offset;
+}
+
+void QuadratureEncoder::write(int32_t count) {
+  _offset = count - (int32_t)_tc->TC_CHANNEL[0].TC_CV;
+}
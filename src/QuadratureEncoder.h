@@ -0,0 +1,52 @@
+/*
+  QuadratureEncoder.h - Reads a quadrature encoder using the hardware
+  quadrature decoder of the Arduino Due's timer counters.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef QUADRATURE_ENCODER_H
+#define QUADRATURE_ENCODER_H
+
+#include <Arduino.h>
+#include "InterruptStepperConfig.h"
+
+class QuadratureEncoder {
+public:
+  // The constructor takes the timer counter block whose quadrature decoder
+  // will count the encoder edges. There are 2 blocks that can be used:
+  // - `TC0` - the encoder's A and B outputs are connected to pins 2 and 13.
+  //   The `Timer0` and `Timer1` timers can not be used by anything else.
+  // - `TC2` - the encoder's A and B outputs are connected to pins 5 and 4.
+  //   The `Timer6` and `Timer7` timers can not be used by anything else.
+  // `filter` sets the glitch filter on the inputs (0 - 63), which rejects
+  // pulses shorter than (filter + 1) * 3 master clock periods.
+  QuadratureEncoder(Tc* tc, uint8_t filter = 2);
+
+  // Configures the pins and the timer counter and starts counting from 0.
+  void begin();
+
+  // Returns the current encoder count. Reading it is only a single register
+  // access, so it can be called from within interrupts. The method is
+  // virtual so that the encoder readings can be substituted, for example to
+  // simulate slipping of the motor.
+  INTERRUPT_STEPPER_RAMFUNC virtual int32_t read();
+
+  // Sets the current encoder count to the provided value.
+  void write(int32_t count);
+
+  virtual ~QuadratureEncoder() {}
+
+private:
+  // The timer counter block running in the quadrature decoder mode
+  Tc* _tc;
+  // Glitch filter setting
+  uint8_t _filter;
+  // Value added to the hardware counter
+  int32_t _offset = 0;
+};
+
+#endif
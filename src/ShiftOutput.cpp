@@ -0,0 +1,133 @@
+/*
+  ShiftOutput.cpp - Step and direction outputs on a chain of shift registers
+  driven by the SSC peripheral.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "ShiftOutput.h"
+
+// DMA channel and the DMA hardware interface of the SSC transmitter
+#define SHIFT_OUTPUT_DMA_CHANNEL 2
+#define SHIFT_OUTPUT_DMA_INTERFACE 3
+// Time (in μs) the DMA controller takes to start a transfer
+#define SHIFT_OUTPUT_SETUP_TIME 1
+
+ShiftOutput::ShiftOutput(uint8_t length, uint32_t clock) {
+  // The shift clock is MCK / (2 * DIV)
+  uint32_t divider = clock > 0 ? (VARIANT_MCK / 2 + clock - 1) / clock : 4095;
+  if (divider < 1)
+    divider = 1;
+  if (divider > 4095)
+    divider = 4095;
+  _divider = divider;
+  if (length > SHIFT_OUTPUT_MAX_BITS)
+    length = SHIFT_OUTPUT_MAX_BITS;
+  // Bits beyond the end of a shorter chain are simply shifted through it
+  _words = (length + 31) / 32;
+  if (_words == 0)
+    _words = 1;
+  for (uint8_t i = 0; i < SHIFT_OUTPUT_MAX_BITS / 32; i++) {
+    _image[i] = 0;
+    _inverted[i] = 0;
+  }
+}
+
+void ShiftOutput::begin() {
+  PIO_Configure(PIOA, PIO_PERIPH_B, PIO_PA14B_TK | PIO_PA15B_TF 
+                | PIO_PA16B_TD, PIO_DEFAULT);
+  pmc_enable_periph_clk(ID_SSC);
+  pmc_enable_periph_clk(ID_DMAC);
+
+  SSC->SSC_CR = SSC_CR_SWRST;
+  SSC->SSC_CMR = SSC_CMR_DIV(_divider);
+  // The clock only runs while shifting. The data changes on its falling
+  // edge, so it's stable at the rising edge sampled by the registers.
+  SSC->SSC_TCMR = SSC_TCMR_CKS_MCK | SSC_TCMR_CKO_TRANSFER 
+                  | SSC_TCMR_START_CONTINUOUS | SSC_TCMR_STTDLY(0) 
+                  | SSC_TCMR_PERIOD(0);
+  // One frame of 32 bit words per transfer. TF is low while the frame is
+  // shifted out and its rising edge at the end of the frame latches the
+  // outputs of all the registers at once.
+  SSC->SSC_TFMR = SSC_TFMR_DATLEN(31) | SSC_TFMR_MSBF 
+                  | SSC_TFMR_DATNB(_words - 1) | SSC_TFMR_FSOS_LOW;
+  SSC->SSC_CR = SSC_CR_TXEN;
+
+  DMAC->DMAC_EN = DMAC_EN_ENABLE;
+
+  _dirty = true;
+  flush();
+}
+
+void ShiftOutput::write(uint8_t first_bit, uint8_t count, uint8_t mask) {
+  // The steppers writing to the chain can run in interrupts of different
+  // priorities, which must not interrupt each other's read-modify-write
+  __disable_irq();
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t bit = first_bit + i;
+    if (bit >= _words * 32)
+      break;
+    if (mask & (1 << i))
+      _image[wordOf(bit)] |= 1UL << (bit % 32);
+    else
+      _image[wordOf(bit)] &= ~(1UL << (bit % 32));
+  }
+  _dirty = true;
+  __enable_irq();
+}
+
+void ShiftOutput::setInverted(uint8_t bit, bool inverted) {
+  if (bit >= _words * 32)
+    return;
+  noInterrupts();
+  if (inverted)
+    _inverted[wordOf(bit)] |= 1UL << (bit % 32);
+  else
+    _inverted[wordOf(bit)] &= ~(1UL << (bit % 32));
+  _dirty = true;
+  interrupts();
+}
+
+void ShiftOutput::flush() {
+  if (!_dirty || busy())
+    return;
+
+  __disable_irq();
+  for (uint8_t i = 0; i < _words; i++)
+    _tx[i] = _image[i] ^ _inverted[i];
+  _dirty = false;
+  __enable_irq();
+
+  DmacCh_num* ch = &DMAC->DMAC_CH_NUM[SHIFT_OUTPUT_DMA_CHANNEL];
+  ch->DMAC_SADDR = (uint32_t)_tx;
+  ch->DMAC_DADDR = (uint32_t)&SSC->SSC_THR;
+  ch->DMAC_DSCR = 0;
+  ch->DMAC_CTRLA = _words | DMAC_CTRLA_SRC_WIDTH_WORD | DMAC_CTRLA_DST_WIDTH_WORD;
+  ch->DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR 
+                   | DMAC_CTRLB_FC_MEM2PER_DMA_FC | DMAC_CTRLB_SRC_INCR_INCREMENTING 
+                   | DMAC_CTRLB_DST_INCR_FIXED;
+  ch->DMAC_CFG = DMAC_CFG_DST_PER(SHIFT_OUTPUT_DMA_INTERFACE) 
+                 | DMAC_CFG_DST_H2SEL | DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ALAP_CFG;
+  DMAC->DMAC_CHER = DMAC_CHER_ENA0 << SHIFT_OUTPUT_DMA_CHANNEL;
+}
+
+bool ShiftOutput::busy() {
+  // The last word may still be shifted out after the DMA channel finished
+  return (DMAC->DMAC_CHSR & (DMAC_CHSR_ENA0 << SHIFT_OUTPUT_DMA_CHANNEL)) 
+         || !(SSC->SSC_SR & SSC_SR_TXEMPTY);
+}
+
+uint32_t ShiftOutput::transferTime() {
+  // Every bit takes 2 * DIV cycles of the master clock
+  uint32_t cycles = (uint32_t)_words * 32 * 2 * _divider;
+  uint32_t mhz = VARIANT_MCK / 1000000;
+  return (cycles + mhz - 1) / mhz + SHIFT_OUTPUT_SETUP_TIME;
+}
+
+uint8_t ShiftOutput::wordOf(uint8_t bit) {
+  // The first outputs are shifted out last
+  return _words - 1 - bit / 32;
+}
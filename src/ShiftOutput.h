@@ -0,0 +1,76 @@
+/*
+  ShiftOutput.h - Step and direction outputs on a chain of shift registers
+  driven by the SSC peripheral.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef SHIFT_OUTPUT_H
+#define SHIFT_OUTPUT_H
+
+#include <Arduino.h>
+#include "InterruptStepperConfig.h"
+
+// Maximum length of the chain in bits (16 registers of 8 bits)
+#define SHIFT_OUTPUT_MAX_BITS 128
+
+// A chain of serial-in, parallel-out shift registers (74HC595 or similar)
+// whose outputs are used as the step and direction pins of many drivers.
+// The outputs are kept in a bit image in memory and the whole image is sent
+// by the DMA controller to the SSC peripheral in a single transfer, so
+// updating the outputs takes the same time however many axes there are.
+// The registers are wired to the SSC transmitter of the Due:
+//  - TD (pin A0) - serial data input of the first register (SER),
+//  - TK (pin 23) - shift clocks of all the registers (SRCLK),
+//  - TF (pin 24) - storage clocks of all the registers (RCLK).
+// Bit 0 is the first output (QA) of the first register in the chain. Uses
+// DMA channel 2.
+class ShiftOutput {
+public:
+  // `length` is the number of outputs of the chain (8 per register) and
+  // `clock` is the shift clock frequency in Hz.
+  ShiftOutput(uint8_t length = 32, uint32_t clock = 10500000);
+
+  // Configures the SSC pins, the peripheral and the DMA controller and
+  // clears all the outputs.
+  void begin();
+
+  // Sets `count` outputs starting from `first_bit` to the lowest bits of
+  // `mask`. The outputs change at the next `flush()`.
+  INTERRUPT_STEPPER_RAMFUNC void write(uint8_t first_bit, uint8_t count, 
+                                       uint8_t mask);
+  // Inverts an output, so that writing 1 sets it LOW.
+  void setInverted(uint8_t bit, bool inverted = true);
+
+  // Starts sending the bit image to the registers if it changed since the
+  // last flush. If the previous transfer hasn't finished yet the image is
+  // sent by the next flush instead. Called by the step engine at the end of
+  // every tick.
+  INTERRUPT_STEPPER_RAMFUNC void flush();
+  // Returns true while a transfer is in progress.
+  INTERRUPT_STEPPER_RAMFUNC bool busy();
+  // Returns the time (in μs, rounded up) a transfer of the whole chain takes.
+  uint32_t transferTime();
+
+private:
+  // Returns the index of the image word holding the output
+  INTERRUPT_STEPPER_RAMFUNC uint8_t wordOf(uint8_t bit);
+
+  // Divider of the master clock giving the shift clock (MCK / (2 * DIV))
+  uint16_t _divider;
+  // Number of 32 bit words sent in a transfer
+  uint8_t _words;
+  // The outputs, with the first word shifted out first. The last bit
+  // shifted out ends up in the first output of the chain.
+  uint32_t _image[SHIFT_OUTPUT_MAX_BITS / 32];
+  uint32_t _inverted[SHIFT_OUTPUT_MAX_BITS / 32];
+  // Copy of the image being sent, so that the image can change meanwhile
+  uint32_t _tx[SHIFT_OUTPUT_MAX_BITS / 32];
+  // Whether the image changed since the last transfer
+  volatile bool _dirty = false;
+};
+
+#endif
@@ -0,0 +1,332 @@
+/*
+  SmartDriverBus.cpp - SPI bus shared by stepper drivers with built-in motion
+  controllers (TMC5160 and similar).
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "SmartDriverBus.h"
+#include "SmartDriverStepper.h"
+
+// DMA channels and the DMA hardware interfaces of the SPI0 peripheral
+#define SMART_DRIVER_DMA_TX_CHANNEL 0
+#define SMART_DRIVER_DMA_RX_CHANNEL 1
+#define SMART_DRIVER_DMA_TX_INTERFACE 1
+#define SMART_DRIVER_DMA_RX_INTERFACE 2
+// Bit set in the address byte of write datagrams
+#define SMART_DRIVER_WRITE 0x80
+// Longest time step (in s) of the simulated ramps
+#define SMART_DRIVER_SIM_STEP 0.0001
+// Flags of RAMP_STAT reported by the simulated drivers
+#define TMC_RAMP_STAT_VELOCITY_REACHED (1 << 8)
+#define TMC_RAMP_STAT_POSITION_REACHED (1 << 9)
+#define TMC_RAMP_STAT_VZERO            (1 << 10)
+#define TMC_STATUS_VELOCITY_REACHED    (1 << 4)
+// Velocity mode of RAMPMODE moving towards negative positions
+#define TMC_RAMPMODE_VELOCITY_NEGATIVE 2
+
+void SmartDriverBus::poll() {
+  if (busy())
+    return;
+  collect();
+  if (_count == 0)
+    return;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    uint8_t* datagram = &_datagrams[i * SMART_DRIVER_DATAGRAM_SIZE];
+    memset(datagram, 0, SMART_DRIVER_DATAGRAM_SIZE);
+    datagram[0] = TMC_XACTUAL;
+  }
+  _polling = true;
+  exchange(_chips, _datagrams, _count);
+}
+
+void SmartDriverBus::writeRegister(uint8_t chip, uint8_t address, int32_t value) {
+  uint8_t reply[SMART_DRIVER_DATAGRAM_SIZE];
+  transfer(chip, address | SMART_DRIVER_WRITE, value, reply);
+}
+
+int32_t SmartDriverBus::readRegister(uint8_t chip, uint8_t address) {
+  // The reply to a datagram holds the register addressed by the previous one
+  uint8_t reply[SMART_DRIVER_DATAGRAM_SIZE];
+  transfer(chip, address, 0, reply);
+  transfer(chip, address, 0, reply);
+  return (int32_t)((uint32_t)reply[1] << 24 | (uint32_t)reply[2] << 16 
+                   | (uint32_t)reply[3] << 8 | reply[4]);
+}
+
+bool SmartDriverBus::addDriver(SmartDriverStepper& stepper) {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_drivers[i] == &stepper)
+      return true;
+  }
+  if (_count == SMART_DRIVER_BUS_MAX_DRIVERS)
+    return false;
+
+  _drivers[_count] = &stepper;
+  _chips[_count] = stepper._chip;
+  _count++;
+  return true;
+}
+
+void SmartDriverBus::collect() {
+  if (!_polling)
+    return;
+  _polling = false;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    uint8_t* reply = &_datagrams[i * SMART_DRIVER_DATAGRAM_SIZE];
+    int32_t position = (int32_t)((uint32_t)reply[1] << 24 
+                                 | (uint32_t)reply[2] << 16 
+                                 | (uint32_t)reply[3] << 8 | reply[4]);
+    _drivers[i]->update(reply[0], position);
+  }
+}
+
+void SmartDriverBus::transfer(uint8_t chip, uint8_t address, int32_t value,
+                              uint8_t reply[]) {
+  while (busy());
+  // The replies of the last poll must not be mixed up with the datagrams
+  // written now
+  collect();
+
+  reply[0] = address;
+  reply[1] = (uint32_t)value >> 24;
+  reply[2] = (uint32_t)value >> 16;
+  reply[3] = (uint32_t)value >> 8;
+  reply[4] = (uint32_t)value;
+  exchange(&chip, reply, 1);
+  while (busy());
+
+  // The reply to the next poll of this driver holds the register addressed
+  // now instead of its position
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_chips[i] == chip)
+      _drivers[i]->_skip_position = true;
+  }
+}
+
+SmartDriverSPI::SmartDriverSPI(uint32_t clock) : _clock(clock) {}
+
+void SmartDriverSPI::begin() {
+  // MISO, MOSI, SCK, NPCS0 and NPCS1 are on peripheral A of PIOA, NPCS2 and
+  // NPCS3 on peripheral B of PIOB
+  PIO_Configure(PIOA, PIO_PERIPH_A, PIO_PA25A_SPI0_MISO | PIO_PA26A_SPI0_MOSI 
+                | PIO_PA27A_SPI0_SPCK | PIO_PA28A_SPI0_NPCS0 
+                | PIO_PA29A_SPI0_NPCS1, PIO_DEFAULT);
+  PIO_Configure(PIOB, PIO_PERIPH_B, PIO_PB21B_SPI0_NPCS2 
+                | PIO_PB23B_SPI0_NPCS3, PIO_DEFAULT);
+  pmc_enable_periph_clk(ID_SPI0);
+  pmc_enable_periph_clk(ID_DMAC);
+
+  SPI0->SPI_CR = SPI_CR_SPIDIS;
+  SPI0->SPI_CR = SPI_CR_SWRST;
+  // Master with the chip select chosen by every transmitted word
+  SPI0->SPI_MR = SPI_MR_MSTR | SPI_MR_PS | SPI_MR_MODFDIS | SPI_MR_DLYBCS(42);
+  uint32_t divider = (VARIANT_MCK + _clock - 1) / _clock;
+  if (divider > 255)
+    divider = 255;
+  for (uint8_t i = 0; i < SMART_DRIVER_BUS_MAX_DRIVERS; i++) {
+    // SPI mode 3, 8 bit transfers, chip select kept active until the last
+    // byte of a datagram
+    SPI0->SPI_CSR[i] = SPI_CSR_CPOL | SPI_CSR_CSAAT | SPI_CSR_BITS_8_BIT 
+                       | SPI_CSR_SCBR(divider);
+  }
+  SPI0->SPI_CR = SPI_CR_SPIEN;
+
+  DMAC->DMAC_EN = DMAC_EN_ENABLE;
+}
+
+void SmartDriverSPI::exchange(const uint8_t chips[], uint8_t datagrams[],
+                              uint8_t count) {
+  uint8_t length = count * SMART_DRIVER_DATAGRAM_SIZE;
+  for (uint8_t i = 0; i < length; i++) {
+    uint8_t chip = chips[i / SMART_DRIVER_DATAGRAM_SIZE];
+    // Without a decoder a chip is selected by the only 0 bit of PCS
+    _tx[i] = datagrams[i] | SPI_TDR_PCS(~(1 << chip) & 0xf);
+    if (i % SMART_DRIVER_DATAGRAM_SIZE == SMART_DRIVER_DATAGRAM_SIZE - 1)
+      _tx[i] |= SPI_TDR_LASTXFER;
+  }
+  _replies = datagrams;
+  _length = length;
+  (void)SPI0->SPI_RDR;
+
+  DmacCh_num* rx = &DMAC->DMAC_CH_NUM[SMART_DRIVER_DMA_RX_CHANNEL];
+  rx->DMAC_SADDR = (uint32_t)&SPI0->SPI_RDR;
+  rx->DMAC_DADDR = (uint32_t)_rx;
+  rx->DMAC_DSCR = 0;
+  rx->DMAC_CTRLA = length | DMAC_CTRLA_SRC_WIDTH_HALF_WORD 
+                   | DMAC_CTRLA_DST_WIDTH_HALF_WORD;
+  rx->DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR 
+                   | DMAC_CTRLB_FC_PER2MEM_DMA_FC | DMAC_CTRLB_SRC_INCR_FIXED 
+                   | DMAC_CTRLB_DST_INCR_INCREMENTING;
+  rx->DMAC_CFG = DMAC_CFG_SRC_PER(SMART_DRIVER_DMA_RX_INTERFACE) 
+                 | DMAC_CFG_SRC_H2SEL | DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ASAP_CFG;
+
+  DmacCh_num* tx = &DMAC->DMAC_CH_NUM[SMART_DRIVER_DMA_TX_CHANNEL];
+  tx->DMAC_SADDR = (uint32_t)_tx;
+  tx->DMAC_DADDR = (uint32_t)&SPI0->SPI_TDR;
+  tx->DMAC_DSCR = 0;
+  tx->DMAC_CTRLA = length | DMAC_CTRLA_SRC_WIDTH_WORD | DMAC_CTRLA_DST_WIDTH_WORD;
+  tx->DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR 
+                   | DMAC_CTRLB_FC_MEM2PER_DMA_FC | DMAC_CTRLB_SRC_INCR_INCREMENTING 
+                   | DMAC_CTRLB_DST_INCR_FIXED;
+  tx->DMAC_CFG = DMAC_CFG_DST_PER(SMART_DRIVER_DMA_TX_INTERFACE) 
+                 | DMAC_CFG_DST_H2SEL | DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ALAP_CFG;
+
+  DMAC->DMAC_CHER = (DMAC_CHER_ENA0 << SMART_DRIVER_DMA_RX_CHANNEL) 
+                    | (DMAC_CHER_ENA0 << SMART_DRIVER_DMA_TX_CHANNEL);
+}
+
+bool SmartDriverSPI::busy() {
+  if (_replies == NULL)
+    return false;
+  // The receive channel finishes after the transmit one
+  if (DMAC->DMAC_CHSR & (DMAC_CHSR_ENA0 << SMART_DRIVER_DMA_RX_CHANNEL))
+    return true;
+
+  for (uint8_t i = 0; i < _length; i++)
+    _replies[i] = _rx[i];
+  _replies = NULL;
+  return false;
+}
+
+SmartDriverSimulator::SmartDriverSimulator(float clock) : _clock(clock) {
+  for (uint8_t i = 0; i < SMART_DRIVER_BUS_MAX_DRIVERS; i++) {
+    for (uint8_t j = 0; j < 128; j++)
+      _registers[i][j] = 0;
+    _read_address[i] = 0;
+    _position[i] = 0.0;
+    _velocity[i] = 0.0;
+  }
+}
+
+void SmartDriverSimulator::exchange(const uint8_t chips[], uint8_t datagrams[],
+                                    uint8_t count) {
+  uint32_t now = micros();
+  if (_started)
+    advance((now - _last_time) * 1e-6);
+  _started = true;
+  _last_time = now;
+
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t chip = chips[i] % SMART_DRIVER_BUS_MAX_DRIVERS;
+    uint8_t* datagram = &datagrams[i * SMART_DRIVER_DATAGRAM_SIZE];
+    uint8_t address = datagram[0] & ~SMART_DRIVER_WRITE;
+    int32_t value = (int32_t)((uint32_t)datagram[1] << 24 
+                              | (uint32_t)datagram[2] << 16 
+                              | (uint32_t)datagram[3] << 8 | datagram[4]);
+
+    int32_t reply = registerValue(chip, _read_address[chip]);
+    if (datagram[0] & SMART_DRIVER_WRITE) {
+      _registers[chip][address] = value;
+      if (address == TMC_XACTUAL)
+        _position[chip] = value;
+    } else {
+      _read_address[chip] = address;
+    }
+
+    datagram[0] = statusByte(chip);
+    datagram[1] = (uint32_t)reply >> 24;
+    datagram[2] = (uint32_t)reply >> 16;
+    datagram[3] = (uint32_t)reply >> 8;
+    datagram[4] = (uint32_t)reply;
+  }
+}
+
+void SmartDriverSimulator::advance(float dt) {
+  for (uint8_t chip = 0; chip < SMART_DRIVER_BUS_MAX_DRIVERS; chip++) {
+    for (float left = dt; left > 0.0; left -= SMART_DRIVER_SIM_STEP)
+      advanceMotor(chip, left < SMART_DRIVER_SIM_STEP ? left 
+                                                      : SMART_DRIVER_SIM_STEP);
+  }
+}
+
+float SmartDriverSimulator::velocity(uint8_t chip) {
+  return _velocity[chip % SMART_DRIVER_BUS_MAX_DRIVERS];
+}
+
+void SmartDriverSimulator::advanceMotor(uint8_t chip, float dt) {
+  int32_t* registers = _registers[chip];
+  // v = VMAX * fCLK / 2^24, a = AMAX * fCLK^2 / 2^41
+  float vmax = registers[TMC_VMAX] * _clock / 16777216.0;
+  float amax = registers[TMC_AMAX] * _clock * _clock / 2199023255552.0;
+  float dmax = registers[TMC_DMAX] * _clock * _clock / 2199023255552.0;
+  float v = _velocity[chip];
+
+  float wanted;
+  switch (registers[TMC_RAMPMODE]) {
+    case TMC_RAMPMODE_POSITION: {
+      // Aim for the speed from which the motor can still stop at the target
+      float distance = registers[TMC_XTARGET] - _position[chip];
+      float reachable = sqrt(2.0 * dmax * fabs(distance));
+      wanted = reachable < vmax ? reachable : vmax;
+      if (distance < 0.0)
+        wanted = -wanted;
+      // Land exactly on the target instead of oscillating around it
+      if (fabs(distance) <= fabs(v) * dt + 0.5 && fabs(v) <= dmax * dt 
+                                                   + sqrt(2.0 * dmax)) {
+        _position[chip] = registers[TMC_XTARGET];
+        _velocity[chip] = 0.0;
+        return;
+      }
+      break;
+    }
+    case TMC_RAMPMODE_VELOCITY_POSITIVE:
+      wanted = vmax;
+      break;
+    case TMC_RAMPMODE_VELOCITY_NEGATIVE:
+      wanted = -vmax;
+      break;
+    default:
+      // Hold mode: keep the current velocity
+      wanted = v;
+  }
+
+  // Speeding up uses AMAX, slowing down DMAX (AMAX in the velocity modes)
+  bool slowing = fabs(wanted) < fabs(v) || (wanted > 0.0) != (v > 0.0);
+  float rate = (slowing && registers[TMC_RAMPMODE] == TMC_RAMPMODE_POSITION) 
+               ? dmax : amax;
+  float change = rate * dt;
+  if (wanted > v)
+    v = v + change < wanted ? v + change : wanted;
+  else
+    v = v - change > wanted ? v - change : wanted;
+
+  _velocity[chip] = v;
+  _position[chip] += v * dt;
+}
+
+int32_t SmartDriverSimulator::registerValue(uint8_t chip, uint8_t address) {
+  int32_t* registers = _registers[chip];
+  if (address == TMC_XACTUAL)
+    return lround(_position[chip]);
+  if (address == TMC_RAMP_STAT) {
+    int32_t stat = 0;
+    float vmax = registers[TMC_VMAX] * _clock / 16777216.0;
+    if (_velocity[chip] == 0.0)
+      stat |= TMC_RAMP_STAT_VZERO;
+    if (fabs(_velocity[chip]) == vmax)
+      stat |= TMC_RAMP_STAT_VELOCITY_REACHED;
+    if (registers[TMC_RAMPMODE] == TMC_RAMPMODE_POSITION 
+        && _position[chip] == registers[TMC_XTARGET])
+      stat |= TMC_RAMP_STAT_POSITION_REACHED;
+    return stat;
+  }
+  return registers[address];
+}
+
+uint8_t SmartDriverSimulator::statusByte(uint8_t chip) {
+  int32_t stat = registerValue(chip, TMC_RAMP_STAT);
+  uint8_t status = 0;
+  if (stat & TMC_RAMP_STAT_VZERO)
+    status |= TMC_STATUS_STANDSTILL;
+  if (stat & TMC_RAMP_STAT_VELOCITY_REACHED)
+    status |= TMC_STATUS_VELOCITY_REACHED;
+  if (stat & TMC_RAMP_STAT_POSITION_REACHED)
+    status |= TMC_STATUS_POSITION_REACHED;
+  return status;
+}
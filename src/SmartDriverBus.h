@@ -0,0 +1,144 @@
+/*
+  SmartDriverBus.h - SPI bus shared by stepper drivers with built-in motion
+  controllers (TMC5160 and similar).
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef SMART_DRIVER_BUS_H
+#define SMART_DRIVER_BUS_H
+
+#include <Arduino.h>
+
+// Maximum number of drivers on a single bus (the SPI0 chip selects of the Due)
+#define SMART_DRIVER_BUS_MAX_DRIVERS 4
+// Length of an SPI datagram: address/status byte and 32 bits of data
+#define SMART_DRIVER_DATAGRAM_SIZE 5
+
+class SmartDriverStepper;
+
+// Transports the datagrams to the drivers and polls their positions. The
+// transport itself is done by the `exchange()` and `busy()` methods, which
+// can be overridden to use a different SPI peripheral or to simulate the
+// drivers.
+class SmartDriverBus {
+public:
+  // Starts exchanging `count` datagrams, the i-th one with the driver
+  // selected by `chips[i]`. The datagrams follow each other in `datagrams`
+  // and are replaced by the replies once `busy()` returns false.
+  virtual void exchange(const uint8_t chips[], uint8_t datagrams[], 
+                        uint8_t count) = 0;
+
+  // Returns true while an exchange is in progress.
+  virtual bool busy() { return false; }
+
+  // Reads the positions and statuses of all the drivers on the bus with a
+  // single batch of datagrams. Finishing the batch doesn't need the CPU, so
+  // this method only collects the results of the previous batch and starts
+  // the next one. It should be called as often as possible, e.g. in every
+  // iteration of `loop()`. Does nothing if the previous batch hasn't finished.
+  void poll();
+
+  // Writes a driver register. Waits for the current batch to finish.
+  void writeRegister(uint8_t chip, uint8_t address, int32_t value);
+  // Reads a driver register. Waits for the current batch to finish.
+  int32_t readRegister(uint8_t chip, uint8_t address);
+
+  virtual ~SmartDriverBus() {}
+
+private:
+  friend class SmartDriverStepper;
+
+  // Registers the stepper so that it's polled
+  bool addDriver(SmartDriverStepper& stepper);
+  // Hands the replies of a finished poll over to the steppers
+  void collect();
+  // Exchanges a single datagram and waits for the reply
+  void transfer(uint8_t chip, uint8_t address, int32_t value, 
+                uint8_t reply[]);
+
+  SmartDriverStepper* _drivers[SMART_DRIVER_BUS_MAX_DRIVERS];
+  uint8_t _chips[SMART_DRIVER_BUS_MAX_DRIVERS];
+  uint8_t _count = 0;
+  uint8_t _datagrams[SMART_DRIVER_BUS_MAX_DRIVERS * SMART_DRIVER_DATAGRAM_SIZE];
+  // Whether the datagrams hold the replies of a poll not collected yet
+  bool _polling = false;
+};
+
+// Runs the datagrams over the SPI0 peripheral using the DMA controller, so
+// that a whole batch is sent without any CPU involvement. Each driver gets
+// its own chip select (0 - pin 10, 1 - pin 4, 2 - pin 52, 3 - pin 78) chosen
+// for every byte by the DMA itself (variable peripheral select). Uses DMA
+// channels 0 (transmit) and 1 (receive).
+class SmartDriverSPI : public SmartDriverBus {
+public:
+  // `clock` is the SPI clock frequency in Hz. TMC5160 drivers running on
+  // their internal clock allow up to 4 MHz.
+  SmartDriverSPI(uint32_t clock = 4000000);
+
+  // Configures the SPI pins, the peripheral and the DMA controller.
+  void begin();
+
+  void exchange(const uint8_t chips[], uint8_t datagrams[], 
+                uint8_t count) override;
+  bool busy() override;
+
+private:
+  uint32_t _clock;
+  // Words written to the transmit register (data, chip select, end of
+  // datagram) and halfwords read from the receive register
+  uint32_t _tx[SMART_DRIVER_BUS_MAX_DRIVERS * SMART_DRIVER_DATAGRAM_SIZE];
+  uint16_t _rx[SMART_DRIVER_BUS_MAX_DRIVERS * SMART_DRIVER_DATAGRAM_SIZE];
+  // Where the replies of the current exchange go
+  uint8_t* _replies = NULL;
+  uint8_t _length = 0;
+};
+
+// Simulates the ramp generators of the drivers instead of talking to them,
+// so that sketches using `SmartDriverStepper` can be tried out and tested
+// without any drivers connected. Every chip select has its own set of
+// registers. XACTUAL follows a trapezoidal ramp towards XTARGET limited by
+// VMAX and AMAX/DMAX (or towards +/-VMAX in the velocity modes), advanced
+// with `micros()` at every exchange, and RAMP_STAT and the status byte report
+// the standstill and the reached position like the real drivers. All the
+// other registers just keep the values written to them.
+class SmartDriverSimulator : public SmartDriverBus {
+public:
+  // `clock` is the simulated clock frequency of the drivers, it must match
+  // the clock passed to the steppers.
+  SmartDriverSimulator(float clock = 12000000.0);
+
+  void exchange(const uint8_t chips[], uint8_t datagrams[], 
+                uint8_t count) override;
+
+  // Advances the simulated motors by `dt` seconds. Called by `exchange()`
+  // with the time since the last exchange.
+  void advance(float dt);
+
+  // Returns the simulated velocity (steps/s) of the motor of the chip.
+  float velocity(uint8_t chip);
+
+private:
+  // Advances the motor of the chip by `dt` seconds
+  void advanceMotor(uint8_t chip, float dt);
+  // Returns the current value of the register, including the simulated ones
+  int32_t registerValue(uint8_t chip, uint8_t address);
+  // Returns the status byte of the chip
+  uint8_t statusByte(uint8_t chip);
+
+  float _clock;
+  uint32_t _last_time;
+  bool _started = false;
+  int32_t _registers[SMART_DRIVER_BUS_MAX_DRIVERS][128];
+  // The reply to a datagram holds the register read by the previous one
+  uint8_t _read_address[SMART_DRIVER_BUS_MAX_DRIVERS];
+  // Simulated position (steps) and velocity (steps/s). The position needs
+  // the precision of a double to add up the slow steps far from 0.
+  double _position[SMART_DRIVER_BUS_MAX_DRIVERS];
+  float _velocity[SMART_DRIVER_BUS_MAX_DRIVERS];
+};
+
+#endif
@@ -0,0 +1,172 @@
+/*
+  SmartDriverStepper.cpp - Runs a stepper motor using the ramp generator
+  built into TMC5160-class drivers over SPI.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "SmartDriverStepper.h"
+
+// Hold mode of RAMPMODE, in which the motor keeps its current velocity
+#define TMC_RAMPMODE_HOLD 3
+// Largest allowed VMAX and AMAX register values
+#define TMC_VMAX_LIMIT 0x7ffe00
+#define TMC_AMAX_LIMIT 0xffff
+// VSTOP used by the library (the driver requires VSTOP >= VSTART)
+#define TMC_VSTOP_DEFAULT 10
+
+SmartDriverStepper::SmartDriverStepper(SmartDriverBus& bus, uint8_t chip,
+                                       float clock)
+  : _bus(bus), _chip(chip), _clock(clock) {}
+
+bool SmartDriverStepper::begin() {
+  if (!_bus.addDriver(*this))
+    return false;
+
+  writeRegister(TMC_RAMPMODE, TMC_RAMPMODE_HOLD);
+  writeRegister(TMC_XACTUAL, 0);
+  writeRegister(TMC_XTARGET, 0);
+  // With V1 = 0 the ramp only uses AMAX and DMAX, which makes it a
+  // trapezoid like in AccelStepper
+  writeRegister(TMC_VSTART, 0);
+  writeRegister(TMC_V1, 0);
+  writeRegister(TMC_VSTOP, TMC_VSTOP_DEFAULT);
+  setAcceleration(_acceleration);
+  writeRegister(TMC_VMAX, velocityRegister(_max_speed));
+  writeRegister(TMC_RAMPMODE, TMC_RAMPMODE_POSITION);
+
+  _position = 0;
+  _target = 0;
+  _stopping = false;
+  return true;
+}
+
+void SmartDriverStepper::moveTo(long absolute) {
+  _target = absolute;
+  writeRegister(TMC_XTARGET, absolute);
+  // Go back to positioning after `stop()`
+  if (_stopping) {
+    writeRegister(TMC_VMAX, velocityRegister(_max_speed));
+    writeRegister(TMC_RAMPMODE, TMC_RAMPMODE_POSITION);
+    _stopping = false;
+  }
+  _status_stale = true;
+}
+
+void SmartDriverStepper::move(long relative) {
+  moveTo(_position + relative);
+}
+
+void SmartDriverStepper::stop() {
+  // In the velocity mode the driver decelerates to VMAX with AMAX
+  writeRegister(TMC_VMAX, 0);
+  writeRegister(TMC_RAMPMODE, TMC_RAMPMODE_VELOCITY_POSITIVE);
+  _stopping = true;
+  _status_stale = true;
+}
+
+void SmartDriverStepper::setMaxSpeed(float speed) {
+  if (speed < 0.0)
+    speed = -speed;
+  _max_speed = speed;
+  if (!_stopping)
+    writeRegister(TMC_VMAX, velocityRegister(speed));
+}
+
+float SmartDriverStepper::maxSpeed() {
+  return _max_speed;
+}
+
+void SmartDriverStepper::setAcceleration(float acceleration) {
+  if (acceleration == 0.0)
+    return;
+  if (acceleration < 0.0)
+    acceleration = -acceleration;
+  _acceleration = acceleration;
+
+  uint32_t value = accelerationRegister(acceleration);
+  writeRegister(TMC_AMAX, value);
+  writeRegister(TMC_DMAX, value);
+  // Not used with V1 = 0, but D1 must never be 0 in the positioning mode
+  writeRegister(TMC_A1, value);
+  writeRegister(TMC_D1, value);
+}
+
+float SmartDriverStepper::acceleration() {
+  return _acceleration;
+}
+
+long SmartDriverStepper::currentPosition() {
+  return _position;
+}
+
+long SmartDriverStepper::targetPosition() {
+  return _target;
+}
+
+long SmartDriverStepper::distanceToGo() {
+  return _target - _position;
+}
+
+void SmartDriverStepper::setCurrentPosition(long position) {
+  // Hold the motor, so that it doesn't start moving towards the old target
+  // after XACTUAL changes
+  writeRegister(TMC_RAMPMODE, TMC_RAMPMODE_HOLD);
+  writeRegister(TMC_XACTUAL, position);
+  writeRegister(TMC_XTARGET, position);
+  writeRegister(TMC_VMAX, velocityRegister(_max_speed));
+  writeRegister(TMC_RAMPMODE, TMC_RAMPMODE_POSITION);
+  _position = position;
+  _target = position;
+  _stopping = false;
+}
+
+bool SmartDriverStepper::isRunning() {
+  if (_status_stale)
+    return true;
+  if (_stopping)
+    return !(_status & TMC_STATUS_STANDSTILL);
+  return !(_status & TMC_STATUS_POSITION_REACHED);
+}
+
+void SmartDriverStepper::writeRegister(uint8_t address, int32_t value) {
+  _bus.writeRegister(_chip, address, value);
+}
+
+int32_t SmartDriverStepper::readRegister(uint8_t address) {
+  return _bus.readRegister(_chip, address);
+}
+
+uint8_t SmartDriverStepper::status() {
+  return _status;
+}
+
+void SmartDriverStepper::update(uint8_t status, int32_t position) {
+  _status = status;
+  _status_stale = false;
+  if (_skip_position)
+    _skip_position = false;
+  else
+    _position = position;
+
+  // After `stop()` the motor stays wherever it stopped
+  if (_stopping && (status & TMC_STATUS_STANDSTILL))
+    _target = _position;
+}
+
+uint32_t SmartDriverStepper::velocityRegister(float speed) {
+  // v = VMAX * fCLK / 2^24
+  float value = speed * 16777216.0 / _clock;
+  return value < TMC_VMAX_LIMIT ? (uint32_t)value : TMC_VMAX_LIMIT;
+}
+
+uint32_t SmartDriverStepper::accelerationRegister(float acceleration) {
+  // a = AMAX * fCLK^2 / 2^41
+  float value = acceleration * 2199023255552.0 / _clock / _clock;
+  if (value < 1.0)
+    return 1;
+  return value < TMC_AMAX_LIMIT ? (uint32_t)value : TMC_AMAX_LIMIT;
+}
@@ -0,0 +1,113 @@
+/*
+  SmartDriverStepper.h - Runs a stepper motor using the ramp generator built
+  into TMC5160-class drivers over SPI.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef SMART_DRIVER_STEPPER_H
+#define SMART_DRIVER_STEPPER_H
+
+#include "SmartDriverBus.h"
+
+// Ramp generator registers
+#define TMC_RAMPMODE  0x20
+#define TMC_XACTUAL   0x21
+#define TMC_VSTART    0x23
+#define TMC_A1        0x24
+#define TMC_V1        0x25
+#define TMC_AMAX      0x26
+#define TMC_VMAX      0x27
+#define TMC_DMAX      0x28
+#define TMC_D1        0x2A
+#define TMC_VSTOP     0x2B
+#define TMC_XTARGET   0x2D
+#define TMC_RAMP_STAT 0x35
+
+// Register values of RAMPMODE
+#define TMC_RAMPMODE_POSITION 0
+#define TMC_RAMPMODE_VELOCITY_POSITIVE 1
+
+// Flags of the status byte returned with every datagram
+#define TMC_STATUS_STANDSTILL       (1 << 3)
+#define TMC_STATUS_POSITION_REACHED (1 << 5)
+
+// A stepper whose whole speed profile is generated by the driver. The Due
+// only writes the targets and limits to the driver registers and polls the
+// position, so no step interrupts are needed at all.
+//
+// The methods are named after their AccelStepper counterparts, except that
+// they must not be called from interrupts (they use the SPI bus). The
+// profile is a trapezoid with the same acceleration and deceleration, like
+// in AccelStepper. Everything else about the driver (currents, chopper,
+// microstepping) has to be configured with `writeRegister()` before use.
+class SmartDriverStepper {
+public:
+  // `chip` is the chip select of the driver on the `bus`. `clock` is the
+  // clock frequency of the driver (12 MHz when running on its internal clock).
+  SmartDriverStepper(SmartDriverBus& bus, uint8_t chip, 
+                     float clock = 12000000.0);
+
+  // Configures the ramp generator for positioning and sets the current and
+  // target positions to 0. Returns false if the bus is already full.
+  bool begin();
+
+  void moveTo(long absolute);
+  void move(long relative);
+  // Decelerates to a stop at the set acceleration.
+  void stop();
+  void setMaxSpeed(float speed);
+  float maxSpeed();
+  void setAcceleration(float acceleration);
+  float acceleration();
+  // Returns the position read by the last poll of the bus.
+  long currentPosition();
+  long targetPosition();
+  long distanceToGo();
+  // Sets the current and target position. Should only be called while the
+  // motor is stationary.
+  void setCurrentPosition(long position);
+  // Returns true until a poll of the bus reports that the target was
+  // reached (or that the motor stopped after `stop()`).
+  bool isRunning();
+
+  // Writes a driver register, e.g. to configure the motor current.
+  void writeRegister(uint8_t address, int32_t value);
+  // Reads a driver register.
+  int32_t readRegister(uint8_t address);
+
+  // Returns the status byte returned by the driver during the last poll.
+  uint8_t status();
+
+private:
+  friend class SmartDriverBus;
+
+  // Receives the status and position from a poll of the bus
+  void update(uint8_t status, int32_t position);
+  // Converts the speed (steps/s) and acceleration (steps/s^2) into the
+  // register values
+  uint32_t velocityRegister(float speed);
+  uint32_t accelerationRegister(float acceleration);
+
+  SmartDriverBus& _bus;
+  uint8_t _chip;
+  float _clock;
+  float _max_speed = 1.0;
+  float _acceleration = 1.0;
+
+  long _position = 0;
+  long _target = 0;
+  uint8_t _status = TMC_STATUS_POSITION_REACHED | TMC_STATUS_STANDSTILL;
+  // Set after `stop()`, which switches the driver to the velocity mode
+  bool _stopping = false;
+  // The reply data of the next poll belongs to a write, not to XACTUAL
+  bool _skip_position = false;
+  // The next poll is the first one started after a new target was written,
+  // until then the status still describes the previous move
+  bool _status_stale = false;
+};
+
+#endif
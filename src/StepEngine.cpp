@@ -0,0 +1,193 @@
+/*
+  StepEngine.cpp - Runs the steps of multiple InterruptSteppers from a single
+  fixed-frequency timer using phase accumulators.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "StepEngine.h"
+
+// Intervals are limited to this value (about 16.7 s) so that the rate can be
+// computed with 32 bit divisions
+#define STEP_ENGINE_MAX_INTERVAL 0xffffff
+
+StepEngine::StepEngine(PrecDueTimer& timer, uint8_t tick_period)
+  : _timer(timer), _tick_period(tick_period) {}
+
+void StepEngine::attachInterrupt(void (*isr)()) {
+  _timer.attachInterrupt(isr);
+}
+
+void StepEngine::begin() {
+  _timer.start(_tick_period);
+}
+
+void StepEngine::end() {
+  _timer.stop();
+}
+
+bool StepEngine::addStepper(InterruptStepper& stepper) {
+  if (_size == STEP_ENGINE_MAX_STEPPERS || stepper.isRunning()
+      || stepper._pulse_width > _tick_period)
+    return false;
+
+  noInterrupts();
+  _phase[_size] = 0;
+  _rate[_size] = 0;
+  _steppers[_size] = &stepper;
+  stepper._engine = this;
+  stepper._engine_index = _size;
+  _size++;
+  interrupts();
+  return true;
+}
+
+uint8_t StepEngine::size() {
+  return _size;
+}
+
+bool StepEngine::setShiftOutput(ShiftOutput& output) {
+  if (output.transferTime() >= _tick_period)
+    return false;
+  noInterrupts();
+  _output = &output;
+  interrupts();
+  return true;
+}
+
+void StepEngine::tick() {
+  // End the step pulses started in the previous tick
+  if (_ends_pending) {
+    writeSteps(_end_set, _end_clear);
+    _ends_pending = false;
+  }
+  if (_pulses) {
+    for (uint8_t i = 0; i < _size; i++) {
+      if (_pulses & (1UL << i))
+        _steppers[i]->endStepPulse();
+    }
+    _pulses = 0;
+  }
+
+  // Make the steps delayed by a change of direction once the setup time
+  // has passed
+  uint32_t released = 0;
+  if (_deferred) {
+    for (uint8_t i = 0; i < _size; i++) {
+      if ((_deferred & (1UL << i)) && --_defer_ticks[i] == 0) {
+        _deferred &= ~(1UL << i);
+        released |= 1UL << i;
+        _steppers[i]->stepPulse();
+      }
+    }
+  }
+
+  for (uint8_t i = 0; i < _size; i++) {
+    uint32_t phase = _phase[i] + _rate[i];
+    // A step is made every time the accumulator overflows
+    bool step = phase < _phase[i];
+    // A step released above already pulses the step pin in this tick and
+    // would be fused with this one. The phase is kept, so that the
+    // accumulator overflows again in the next tick.
+    if (step && (released & (1UL << i)))
+      continue;
+    _phase[i] = phase;
+    if (step)
+      _steppers[i]->stepInterrupt();
+  }
+
+  // The step pins of all the steppers that stepped in this tick change at
+  // once, with one write per port. The pulses are ended by the opposite
+  // writes in the next tick.
+  if (_steps_pending) {
+    writeSteps(_step_set, _step_clear);
+    for (uint8_t i = 0; i < STEP_ENGINE_PORTS; i++) {
+      _end_set[i] = _step_clear[i];
+      _end_clear[i] = _step_set[i];
+      _step_set[i] = 0;
+      _step_clear[i] = 0;
+    }
+    _steps_pending = false;
+    _ends_pending = true;
+  }
+
+  // All the outputs changed in this tick are sent in a single transfer
+  if (_output != NULL)
+    _output->flush();
+}
+
+void StepEngine::schedule(uint8_t index, uint32_t interval, bool restart) {
+  uint32_t r = rate(interval);
+  // The steps are scheduled from within the critical sections of the groups
+  // and the velocity loop, so the interrupts are left as they were found
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  // Counting from a phase of 0 the accumulator overflows after the interval.
+  // Otherwise the remainder of the phase is kept, so that the average
+  // interval is exact even though the steps are aligned to the ticks.
+  if (restart)
+    _phase[index] = 0;
+  _rate[index] = r;
+  __set_PRIMASK(primask);
+}
+
+void StepEngine::stopStepper(uint8_t index) {
+  _rate[index] = 0;
+}
+
+void StepEngine::endPulse(uint8_t index) {
+  _pulses |= 1UL << index;
+}
+
+void StepEngine::deferStep(uint8_t index) {
+  // The direction was written during this tick and the step pins are written
+  // at the end of a tick, so a whole tick period passes for every tick waited
+  uint16_t setup = _steppers[index]->_dir_setup;
+  uint16_t ticks = (setup + _tick_period - 1) / _tick_period;
+  _defer_ticks[index] = ticks > 0 ? ticks : 1;
+  _deferred |= 1UL << index;
+}
+
+bool StepEngine::cancelStep(uint8_t index) {
+  bool deferred = _deferred & (1UL << index);
+  _deferred &= ~(1UL << index);
+  return deferred;
+}
+
+void StepEngine::fuseStep(uint8_t port, uint32_t mask, bool inverted) {
+  // Only called from the steps made by `tick()`, so no other interrupt
+  // touches the masks
+  if (inverted)
+    _step_clear[port] |= mask;
+  else
+    _step_set[port] |= mask;
+  _steps_pending = true;
+}
+
+void StepEngine::writeSteps(uint32_t set[], uint32_t clear[]) {
+  Pio* ports[STEP_ENGINE_PORTS] = { PIOA, PIOB, PIOC, PIOD };
+  for (uint8_t i = 0; i < STEP_ENGINE_PORTS; i++) {
+    if (set[i])
+      ports[i]->PIO_SODR = set[i];
+    if (clear[i])
+      ports[i]->PIO_CODR = clear[i];
+  }
+}
+
+uint32_t StepEngine::rate(uint32_t interval) {
+  // At most one step per tick
+  if (interval <= _tick_period)
+    return 0xffffffff;
+  if (interval > STEP_ENGINE_MAX_INTERVAL)
+    interval = STEP_ENGINE_MAX_INTERVAL;
+
+  // rate = tick_period * 2^32 / interval, computed in two steps of 24 and 8
+  // bits to avoid a 64 bit division
+  uint32_t a = (uint32_t)_tick_period << 24;
+  uint32_t q = a / interval;
+  uint32_t r = a % interval;
+  return (q << 8) + ((r << 8) / interval);
+}
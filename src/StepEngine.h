@@ -0,0 +1,113 @@
+/*
+  StepEngine.h - Runs the steps of multiple InterruptSteppers from a single
+  fixed-frequency timer using phase accumulators.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef STEP_ENGINE_H
+#define STEP_ENGINE_H
+
+#include "InterruptStepper.h"
+
+// Maximum number of steppers driven by a single engine
+#define STEP_ENGINE_MAX_STEPPERS 32
+// Number of PIO ports (PIOA to PIOD)
+#define STEP_ENGINE_PORTS 4
+
+class StepEngine {
+public:
+  // Takes the timer that will tick every `tick_period` μs (10 μs means
+  // 100 kHz). The steppers attached to the engine don't use their own
+  // timers, so the timers passed to their constructors can be shared.
+  StepEngine(PrecDueTimer& timer, uint8_t tick_period = 10);
+
+  // Attaches the interrupt function that must call `tick()`:
+  // engine.attachInterrupt([](){ engine.tick(); });
+  void attachInterrupt(void (*isr)());
+
+  // Starts ticking.
+  void begin();
+  // Stops ticking. The attached steppers stop where they are.
+  void end();
+
+  // Attaches the stepper to the engine. From now on its steps are made by
+  // the engine instead of its own timer. The stepper must be stationary and
+  // can't be detached again. A step pulse lasts one tick, so the minimum
+  // pulse width of the stepper can't be longer than the tick period. Returns
+  // false if the engine is already full or the pulse width is too long.
+  bool addStepper(InterruptStepper& stepper);
+
+  // Returns the number of attached steppers.
+  uint8_t size();
+
+  // Makes the engine update the shift register chain at the end of every
+  // tick, so that the attached steppers can use its outputs instead of pins
+  // (see `InterruptStepper::setShiftOutput()`). Returns false if a transfer
+  // of the chain doesn't fit into the tick period, as a step pulse could
+  // then end before the transfer starting it was sent.
+  bool setShiftOutput(ShiftOutput& output);
+
+  // Advances the phase of every stepper and makes the steps that are due.
+  // Must be called from the timer's interrupt.
+  INTERRUPT_STEPPER_RAMFUNC void tick();
+
+private:
+  friend class InterruptStepper;
+
+  // Makes the next step of the stepper `interval` μs after the previous one.
+  // If `restart` is true the interval is counted from now instead.
+  INTERRUPT_STEPPER_RAMFUNC void schedule(uint8_t index, uint32_t interval,
+                                          bool restart);
+  // Stops making the steps of the stepper.
+  INTERRUPT_STEPPER_RAMFUNC void stopStepper(uint8_t index);
+  // Ends the step pulse of the stepper in the next tick.
+  INTERRUPT_STEPPER_RAMFUNC void endPulse(uint8_t index);
+  // Starts a step pulse on the pins `mask` of the port at the end of this
+  // tick and ends it in the next one, together with the other steppers
+  // stepping on the same port.
+  INTERRUPT_STEPPER_RAMFUNC void fuseStep(uint8_t port, uint32_t mask, 
+                                          bool inverted);
+  // Makes the step of the stepper once its direction setup time has passed,
+  // in the first tick at least that long after this one.
+  INTERRUPT_STEPPER_RAMFUNC void deferStep(uint8_t index);
+  // Gives up the deferred step of the stepper. Returns false if there was
+  // none.
+  INTERRUPT_STEPPER_RAMFUNC bool cancelStep(uint8_t index);
+  // Writes the fused step pins to the ports
+  INTERRUPT_STEPPER_RAMFUNC void writeSteps(uint32_t set[], uint32_t clear[]);
+  // Converts the interval (in μs) into the phase increment per tick
+  INTERRUPT_STEPPER_RAMFUNC uint32_t rate(uint32_t interval);
+
+  PrecDueTimer& _timer;
+  uint8_t _tick_period;
+  // Shift register chain updated every tick (NULL if none)
+  ShiftOutput* _output = NULL;
+  uint8_t _size = 0;
+  // Bitmask of the steppers whose step pulse ends in the next tick
+  uint32_t _pulses = 0;
+  // Bitmask of the steppers with a deferred step, and the number of ticks
+  // until it is made
+  uint32_t _deferred = 0;
+  uint16_t _defer_ticks[STEP_ENGINE_MAX_STEPPERS];
+  // Step pins of every port to be set and cleared at the end of this tick,
+  // and to be restored in the next one
+  uint32_t _step_set[STEP_ENGINE_PORTS] = {};
+  uint32_t _step_clear[STEP_ENGINE_PORTS] = {};
+  uint32_t _end_set[STEP_ENGINE_PORTS] = {};
+  uint32_t _end_clear[STEP_ENGINE_PORTS] = {};
+  // Whether any of the fused masks above is not empty
+  bool _steps_pending = false;
+  bool _ends_pending = false;
+
+  // The phase accumulators and their increments are kept in separate arrays
+  // so that a tick only walks through consecutive words
+  uint32_t _phase[STEP_ENGINE_MAX_STEPPERS];
+  uint32_t _rate[STEP_ENGINE_MAX_STEPPERS];
+  InterruptStepper* _steppers[STEP_ENGINE_MAX_STEPPERS];
+};
+
+#endif
@@ -0,0 +1,46 @@
+/*
+  StepProfile.cpp - Integer form of AccelStepper's speed profile, shared by
+  the steppers and interpolators that compute their intervals themselves.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "StepProfile.h"
+
+void StepProfile::setStepsToMaxSpeed(float steps) {
+  if (steps >= STEP_PROFILE_MAX_N)
+    n_max = STEP_PROFILE_MAX_N;
+  else
+    n_max = steps >= 1.0 ? (int32_t)steps : 1;
+}
+
+int32_t StepProfile::stepsToStop() {
+  return n < 0 ? -n : n;
+}
+
+uint32_t StepProfile::nextInterval() {
+  if (n == 0) {
+    // First step of a move, or creeping over the last steps
+    cn = c0 > cmin ? c0 : cmin;
+  } else if (n > 0) {
+    // Equation 13
+    cn -= 2 * (cn / (4 * n + 1));
+  } else {
+    cn += 2 * (cn / (-4 * n - 1));
+  }
+
+  if (n > 0 && (cn <= cmin || n >= n_max)) {
+    // The max speed was reached, so stop counting the steps. `n_max` is also
+    // the number of steps needed to stop from the max speed.
+    cn = cmin;
+    n = n_max;
+  } else {
+    if (cn < cmin)
+      cn = cmin;
+    n++;
+  }
+  return cn;
+}
@@ -0,0 +1,45 @@
+/*
+  StepProfile.h - Integer form of AccelStepper's speed profile, shared by the
+  steppers and interpolators that compute their intervals themselves.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef STEP_PROFILE_H
+#define STEP_PROFILE_H
+
+#include <Arduino.h>
+#include "InterruptStepperConfig.h"
+
+// Limits the step counter so that 4 * n doesn't overflow
+#define STEP_PROFILE_MAX_N 0x1fffffff
+
+// The accelerated profile of AccelStepper (Equations 13 and 15) computed
+// with integer intervals only. The intervals can be in any time unit (μs,
+// timer ticks, ...) as long as all of them are in the same one. The owner
+// decides when to decelerate by negating `n` before asking for the next
+// interval.
+struct StepProfile {
+  // Step counter of the profile (AccelStepper's `_n`). Negative while
+  // decelerating, 0 before the first step of a move.
+  int32_t n;
+  // Step counter at which the max speed is reached
+  int32_t n_max;
+  // Current, first and minimal (max speed) intervals
+  uint32_t cn;
+  uint32_t c0;
+  uint32_t cmin;
+
+  // Sets `n_max` from the number of steps needed to reach the max speed
+  // (v^2 / 2a), limited to the range of the step counter.
+  void setStepsToMaxSpeed(float steps);
+  // Returns the number of steps needed to stop from the current speed.
+  INTERRUPT_STEPPER_RAMFUNC int32_t stepsToStop();
+  // Computes the interval until the next step and advances the step counter.
+  INTERRUPT_STEPPER_RAMFUNC uint32_t nextInterval();
+};
+
+#endif
@@ -0,0 +1,32 @@
+/*
+  StepTrajectory.h - A precomputed sequence of step intervals that can be
+  played back by the InterruptStepper.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef STEP_TRAJECTORY_H
+#define STEP_TRAJECTORY_H
+
+#include <stdint.h>
+
+// The intervals are delta encoded: only the first and the last interval are
+// stored as a whole and each of the others is stored as the difference from
+// the previous one. Step `i` happens `interval[i]` μs after step `i - 1`
+// (or after the playback was started for the first step). Declare the deltas
+// as a `const` array so that they are kept in flash.
+struct StepTrajectory {
+  // Number of steps in the trajectory
+  uint32_t length;
+  // Interval (in μs) before the first step
+  uint32_t first;
+  // Interval (in μs) before the last step, used for reverse playback
+  uint32_t last;
+  // `length - 1` differences between the subsequent intervals
+  const int16_t* deltas;
+};
+
+#endif
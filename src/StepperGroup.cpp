@@ -0,0 +1,272 @@
+/*
+  StepperGroup.cpp - Runs a group of InterruptSteppers through a queue of
+  coordinated moves.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#include "StepperGroup.h"
+
+// Speed factor (16.16) below which a hold parks the steppers
+#define HOLD_PARK_FACTOR (LOAD_SCALE_ONE / 256)
+// Longest interval (μs) between the steps while the hold ramp is running
+#define HOLD_MAX_INTERVAL 1000000
+// The rate of the hold ramp is given per 2^HOLD_RAMP_SHIFT μs
+#define HOLD_RAMP_SHIFT 20
+
+StepperGroup::StepperGroup() {}
+
+bool StepperGroup::addStepper(InterruptStepper& stepper) {
+  if (_size >= STEPPER_GROUP_MAX_STEPPERS)
+    return false;
+  _steppers[_size] = &stepper;
+  _last_targets[_size] = stepper.targetPosition();
+  stepper._group = this;
+  stepper._group_index = _size;
+  _size++;
+  return true;
+}
+
+uint8_t StepperGroup::size() {
+  return _size;
+}
+
+bool StepperGroup::queueMove(const long targets[], float speed, float acceleration) {
+  uint8_t next = (_head + 1) % STEPPER_GROUP_QUEUE_SIZE;
+  if (next == _tail)
+    return false;
+
+  // Find the stepper with the longest distance to go
+  long longest = 0;
+  for (uint8_t i = 0; i < _size; i++) {
+    long distance = labs(targets[i] - _last_targets[i]);
+    if (distance > longest)
+      longest = distance;
+  }
+  if (longest == 0)
+    return true;
+
+  // Scale the speed and acceleration of every stepper by its distance, so
+  // that all of them follow the same speed profile in time
+  Move& move = _queue[_head];
+  for (uint8_t i = 0; i < _size; i++) {
+    float ratio = (float)labs(targets[i] - _last_targets[i]) / longest;
+    move.targets[i] = targets[i];
+    move.speeds[i] = speed * ratio;
+    move.accelerations[i] = acceleration * ratio;
+    _last_targets[i] = targets[i];
+  }
+  _head = next;
+
+  noInterrupts();
+  if (_active == 0)
+    startNextMove();
+  interrupts();
+
+  return true;
+}
+
+uint8_t StepperGroup::queueSpace() {
+  return (_tail - _head + STEPPER_GROUP_QUEUE_SIZE - 1) % STEPPER_GROUP_QUEUE_SIZE;
+}
+
+bool StepperGroup::isRunning() {
+  return _active != 0 || _head != _tail;
+}
+
+void StepperGroup::clearQueue() {
+  noInterrupts();
+  _head = _tail;
+  for (uint8_t i = 0; i < _size; i++)
+    _last_targets[i] = _steppers[i]->targetPosition();
+  interrupts();
+}
+
+void StepperGroup::stepperStopped(uint8_t index) {
+  noInterrupts();
+  if (_active != 0) {
+    _active &= ~(1 << index);
+    if (_active == 0)
+      startNextMove();
+  }
+  interrupts();
+}
+
+void StepperGroup::stepperHalted(uint8_t index) {
+  noInterrupts();
+  _active &= ~(1 << index);
+  _parked &= ~(1 << index);
+  _head = _tail;
+  for (uint8_t i = 0; i < _size; i++)
+    _last_targets[i] = _steppers[i]->targetPosition();
+  interrupts();
+}
+
+bool StepperGroup::hold() {
+  for (uint8_t i = 0; i < _size; i++) {
+    if (_steppers[i]->_velocity_mode)
+      return false;
+  }
+
+  noInterrupts();
+  if (_hold_state == HOLD_DECEL || _hold_state == HOLD_HELD) {
+    interrupts();
+    return true;
+  }
+  if (_active == 0) {
+    _hold_state = HOLD_HELD;
+    interrupts();
+    return true;
+  }
+
+  uint32_t now = micros();
+  // A hold during a resume slows down from the speed reached so far
+  _hold_from = holdFactor(now);
+  _hold_ramp_start = now;
+  // From units per second to 16.16 units per 2^20 μs
+  _hold_rate = holdRate() * LOAD_SCALE_ONE 
+               * ((1UL << HOLD_RAMP_SHIFT) / 1000000.0);
+  if (_hold_rate == 0)
+    _hold_rate = 1;
+  _hold_state = HOLD_DECEL;
+  interrupts();
+  return true;
+}
+
+void StepperGroup::resume() {
+  noInterrupts();
+  if (_hold_state == HOLD_NONE || _hold_state == HOLD_RESUME) {
+    interrupts();
+    return;
+  }
+
+  uint32_t now = micros();
+  float rate = holdRate();
+  _hold_from = holdFactor(now);
+  _hold_ramp_start = now;
+  _hold_rate = rate * LOAD_SCALE_ONE * ((1UL << HOLD_RAMP_SHIFT) / 1000000.0);
+  if (_hold_rate == 0)
+    _hold_rate = 1;
+  bool held = _hold_state == HOLD_HELD;
+  _hold_state = HOLD_RESUME;
+
+  if (held) {
+    for (uint8_t i = 0; i < _size; i++) {
+      if (!(_parked & (1 << i)) || rate <= 0.0)
+        continue;
+      // While the speed factor ramps up from 0 the first step is made after
+      // sqrt(2 * interval / rate)
+      float interval = _intervals[i];
+      _steppers[i]->start(sqrt(2.0 * interval * 1000000.0 / rate));
+    }
+    _parked = 0;
+    // The hold stopped between two moves
+    if (_active == 0) {
+      _hold_state = HOLD_NONE;
+      startNextMove();
+    }
+  }
+  interrupts();
+}
+
+bool StepperGroup::isHolding() {
+  return _hold_state == HOLD_DECEL || _hold_state == HOLD_HELD;
+}
+
+bool StepperGroup::isHeld() {
+  return _hold_state == HOLD_HELD;
+}
+
+void StepperGroup::startNextMove() {
+  // The queued moves wait for the end of a feed hold
+  if (_hold_state == HOLD_DECEL || _hold_state == HOLD_HELD) {
+    if (_active == 0)
+      _hold_state = HOLD_HELD;
+    return;
+  }
+
+  while (_active == 0 && _tail != _head) {
+    Move& move = _queue[_tail];
+    _tail = (_tail + 1) % STEPPER_GROUP_QUEUE_SIZE;
+
+    for (uint8_t i = 0; i < _size; i++) {
+      InterruptStepper& stepper = *_steppers[i];
+      if (move.targets[i] == stepper.currentPosition())
+        continue;
+      stepper.setMaxSpeed(move.speeds[i]);
+      stepper.setAcceleration(move.accelerations[i]);
+      stepper.moveTo(move.targets[i]);
+      // Moves are not started after an emergency stop
+      if (stepper.isRunning())
+        _active |= 1 << i;
+    }
+  }
+}
+
+uint32_t StepperGroup::holdFactor(uint32_t now) {
+  if (_hold_state == HOLD_NONE)
+    return LOAD_SCALE_ONE;
+  if (_hold_state == HOLD_HELD)
+    return 0;
+
+  uint32_t from = _hold_from;
+  uint32_t change = ((uint64_t)(now - _hold_ramp_start) * _hold_rate) 
+                    >> HOLD_RAMP_SHIFT;
+  if (_hold_state == HOLD_DECEL)
+    return change >= from ? 0 : from - change;
+  return change >= LOAD_SCALE_ONE - from ? LOAD_SCALE_ONE : from + change;
+}
+
+uint32_t StepperGroup::holdInterval(uint32_t interval, uint32_t now) {
+  uint32_t factor = holdFactor(now);
+  if (_hold_state == HOLD_RESUME) {
+    if (factor == LOAD_SCALE_ONE) {
+      _hold_state = HOLD_NONE;
+      return interval;
+    }
+    // The first steps after the resume were already timed from a standstill
+    if (factor < HOLD_PARK_FACTOR)
+      factor = HOLD_PARK_FACTOR;
+  } else if (factor < HOLD_PARK_FACTOR) {
+    park();
+    return 0;
+  }
+
+  uint64_t held = ((uint64_t)interval * (0xffffffffUL / factor + 1)) >> 16;
+  return held < HOLD_MAX_INTERVAL ? held : HOLD_MAX_INTERVAL;
+}
+
+void StepperGroup::park() {
+  // The steppers' interrupts can have different priorities
+  __disable_irq();
+  for (uint8_t i = 0; i < _size; i++) {
+    if (!(_active & (1 << i)))
+      continue;
+    InterruptStepper& stepper = *_steppers[i];
+    stepper.stopTimer();
+    stepper.dropDeferredStep();
+    stepper._jitter_armed = false;
+  }
+  _parked = _active;
+  _hold_state = HOLD_HELD;
+  __enable_irq();
+}
+
+float StepperGroup::holdRate() {
+  // The speed factor changes all the speeds proportionally, so the stepper
+  // with the lowest acceleration to max speed ratio limits the ramp
+  float rate = 0.0;
+  for (uint8_t i = 0; i < _size; i++) {
+    InterruptStepper& stepper = *_steppers[i];
+    if (!(_active & (1 << i)) || stepper._maxSpeed <= 0.0 
+        || stepper._acceleration <= 0.0)
+      continue;
+    float stepper_rate = stepper._acceleration / stepper._maxSpeed;
+    if (rate == 0.0 || stepper_rate < rate)
+      rate = stepper_rate;
+  }
+  return rate;
+}
@@ -0,0 +1,132 @@
+/*
+  StepperGroup.h - Runs a group of InterruptSteppers through a queue of
+  coordinated moves.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef STEPPER_GROUP_H
+#define STEPPER_GROUP_H
+
+#include "InterruptStepper.h"
+
+// Maximum number of steppers in a single group
+#define STEPPER_GROUP_MAX_STEPPERS 6
+// Number of moves that can be queued in a group
+#define STEPPER_GROUP_QUEUE_SIZE 16
+
+class StepperGroup {
+public:
+  StepperGroup();
+
+  // Adds the stepper to the group. A stepper can only belong to one group.
+  // Returns false if the group is already full.
+  bool addStepper(InterruptStepper& stepper);
+
+  // Returns the number of steppers in the group.
+  uint8_t size();
+
+  // Queues a move of all the steppers to the absolute `targets` (one for each
+  // stepper, in the order they were added). The speeds and accelerations of
+  // the steppers are scaled so that they all start and finish together.
+  // `speed` (steps/s) and `acceleration` (steps/s^2) apply to the stepper
+  // with the longest distance to go. Moves are started from the step
+  // interrupt as soon as the previous one is finished. Returns false if the
+  // queue is full.
+  bool queueMove(const long targets[], float speed, float acceleration);
+
+  // Returns the number of moves that can still be queued.
+  uint8_t queueSpace();
+
+  // Returns true if any of the steppers is running or there are queued moves.
+  bool isRunning();
+
+  // Removes all moves that haven't been started yet.
+  void clearQueue();
+
+  // Starts a feed hold. All the running steppers slow down together, so they
+  // stay on their path, and are parked once they come to a stop. Unlike
+  // `stop()`, the targets of the current move and the queued moves are kept.
+  // The steppers slow down at their accelerations, so the hold completes
+  // within max speed / acceleration seconds of the slowest stepper plus one
+  // step interval. Can be called from an interrupt (e.g. of a hold button).
+  // Returns false if a stepper of the group is in the velocity mode, whose
+  // steps are rescheduled by the velocity loop and can't be held.
+  bool hold();
+
+  // Ends a feed hold. The parked steppers accelerate back into the current
+  // move and the queued moves follow as usual. Can be called from an
+  // interrupt.
+  void resume();
+
+  // Returns true from the call to `hold()` until the call to `resume()`.
+  bool isHolding();
+
+  // Returns true once the steppers have come to a stop after `hold()`.
+  bool isHeld();
+
+private:
+  friend class InterruptStepper;
+  friend class Kinematics;
+
+  enum HoldState {
+    HOLD_NONE,
+    HOLD_DECEL,
+    HOLD_HELD,
+    HOLD_RESUME
+  };
+
+  // A single queued move
+  struct Move {
+    long targets[STEPPER_GROUP_MAX_STEPPERS];
+    float speeds[STEPPER_GROUP_MAX_STEPPERS];
+    float accelerations[STEPPER_GROUP_MAX_STEPPERS];
+  };
+
+  // Called from the step interrupt once a stepper reaches its target
+  void stepperStopped(uint8_t index);
+  // Called when a stepper is halted before reaching its target. The queued
+  // moves are removed, as the steppers are no longer where they expect.
+  void stepperHalted(uint8_t index);
+  // Starts the next queued move if there is one. Must be called with
+  // interrupts disabled.
+  void startNextMove();
+  // Returns the current speed factor (16.16) of the hold ramp
+  uint32_t holdFactor(uint32_t now);
+  // Returns the planned `interval` of a stepper slowed down by the hold
+  // ramp, or 0 if the steppers were parked. Called from the step interrupt.
+  uint32_t holdInterval(uint32_t interval, uint32_t now);
+  // Stops the timers of all the running steppers, keeping their moves
+  void park();
+  // Returns the slowest rate (1/s) at which the speed factor of the running
+  // steppers can change without exceeding their accelerations
+  float holdRate();
+
+  InterruptStepper* _steppers[STEPPER_GROUP_MAX_STEPPERS];
+  uint8_t _size = 0;
+
+  // Ring buffer of the queued moves
+  Move _queue[STEPPER_GROUP_QUEUE_SIZE];
+  volatile uint8_t _head = 0;
+  volatile uint8_t _tail = 0;
+  // Targets of the last queued move
+  long _last_targets[STEPPER_GROUP_MAX_STEPPERS];
+  // Bit mask of the steppers still running the current move
+  volatile uint8_t _active = 0;
+
+  // Feed hold ramp of the speed factor (16.16), like the feed override's
+  volatile HoldState _hold_state = HOLD_NONE;
+  volatile uint32_t _hold_from = LOAD_SCALE_ONE;
+  volatile uint32_t _hold_ramp_start = 0;
+  // Change of the factor per 2^20 μs
+  volatile uint32_t _hold_rate = 0;
+  // Bit mask of the steppers parked by the hold
+  volatile uint8_t _parked = 0;
+  // Last planned interval (μs) of every stepper, before the hold ramp
+  volatile uint32_t _intervals[STEPPER_GROUP_MAX_STEPPERS];
+};
+
+#endif
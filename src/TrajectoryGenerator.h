@@ -0,0 +1,152 @@
+/*
+  TrajectoryGenerator.h - Generates the step intervals of a fixed move at
+  compile time, to be played back by the InterruptStepper.
+
+  Copyright (C) 2024 Krzysztof Bieliński
+
+  Licensed under GPLv3. For instructions and additional information go to
+  https://github.com/KriBielinski/InterruptStepper
+*/
+
+#ifndef TRAJECTORY_GENERATOR_H
+#define TRAJECTORY_GENERATOR_H
+
+#include "StepTrajectory.h"
+
+// Maximum number of steps in a generated trajectory (2 bytes of flash each)
+#define TRAJECTORY_MAX_LENGTH 32768
+
+// Compile time implementation of the AccelStepper speed profile. The Arduino
+// Due compiles with C++11, so every function consists of a single return
+// statement.
+struct TrajectoryMath {
+  // Square root using Newton's method
+  static constexpr double sqrt(double x) {
+    return x <= 0.0 ? 0.0 : sqrtIter(x, x > 1.0 ? x : 1.0, 64);
+  }
+
+  static constexpr double sqrtIter(double x, double guess, int iterations) {
+    return iterations == 0 || (guess + x / guess) / 2.0 >= guess 
+           ? guess : sqrtIter(x, (guess + x / guess) / 2.0, iterations - 1);
+  }
+
+  // Interval (in μs) of the n-th step when accelerating from standstill.
+  // The first interval is c0 with the correction of Equation 15. The
+  // following ones are the exact values that Equation 13 approximates,
+  // c0 * (sqrt(n + 1) - sqrt(n)), written in a form that doesn't lose
+  // precision for large n.
+  static constexpr double accelInterval(uint32_t n, uint32_t acceleration) {
+    return n == 0 
+      ? 0.676 * sqrt(2.0 / acceleration) * 1000000.0 // Equation 15
+      : sqrt(2.0 / acceleration) * 1000000.0 / (sqrt(n + 1.0) + sqrt(n));
+  }
+
+  // Interval of step `k` of a move of `length` steps, which accelerates from
+  // standstill, cruises at `max_speed` and decelerates back to standstill
+  static constexpr double interval(uint32_t k, uint32_t length, 
+                                   uint32_t max_speed, uint32_t acceleration) {
+    return maximum(accelInterval(k < length - 1 - k ? k : length - 1 - k, acceleration),
+               1000000.0 / max_speed);
+  }
+
+  // Interval rounded to whole μs
+  static constexpr uint32_t roundedInterval(uint32_t k, uint32_t length,
+                                   uint32_t max_speed, uint32_t acceleration) {
+    return (uint32_t)(interval(k, length, max_speed, acceleration) + 0.5);
+  }
+
+  // Difference between the intervals of step `k + 1` and step `k`
+  static constexpr int32_t delta(uint32_t k, uint32_t length, 
+                                 uint32_t max_speed, uint32_t acceleration) {
+    return (int32_t)roundedInterval(k + 1, length, max_speed, acceleration) 
+           - (int32_t)roundedInterval(k, length, max_speed, acceleration);
+  }
+
+  static constexpr double maximum(double a, double b) {
+    return a > b ? a : b;
+  }
+};
+
+// A list of indices 0, 1, ..., N - 1 used to fill the table of deltas
+template <uint32_t... I>
+struct TrajectoryIndices {};
+
+template <class A, class B>
+struct TrajectoryJoinIndices;
+
+template <uint32_t... A, uint32_t... B>
+struct TrajectoryJoinIndices<TrajectoryIndices<A...>, TrajectoryIndices<B...> > {
+  typedef TrajectoryIndices<A..., (sizeof...(A) + B)...> type;
+};
+
+// Builds the indices by halves, so that the template recursion depth is
+// only logarithmic in N
+template <uint32_t N>
+struct TrajectoryMakeIndices {
+  typedef typename TrajectoryJoinIndices<
+    typename TrajectoryMakeIndices<N / 2>::type,
+    typename TrajectoryMakeIndices<N - N / 2>::type>::type type;
+};
+
+template <>
+struct TrajectoryMakeIndices<0> {
+  typedef TrajectoryIndices<> type;
+};
+
+template <>
+struct TrajectoryMakeIndices<1> {
+  typedef TrajectoryIndices<0> type;
+};
+
+template <uint32_t Length, uint32_t MaxSpeed, uint32_t Acceleration, 
+          class Indices>
+struct TrajectoryDeltas;
+
+template <uint32_t Length, uint32_t MaxSpeed, uint32_t Acceleration, 
+          uint32_t... I>
+struct TrajectoryDeltas<Length, MaxSpeed, Acceleration, TrajectoryIndices<I...> > {
+  static constexpr int16_t deltas[sizeof...(I)] = {
+    (int16_t)TrajectoryMath::delta(I, Length, MaxSpeed, Acceleration)...
+  };
+};
+
+template <uint32_t Length, uint32_t MaxSpeed, uint32_t Acceleration, 
+          uint32_t... I>
+constexpr int16_t TrajectoryDeltas<Length, MaxSpeed, Acceleration, 
+                                   TrajectoryIndices<I...> >::deltas[sizeof...(I)];
+
+// Generates the trajectory of a move of `Length` steps that accelerates at
+// `Acceleration` (steps/s^2) up to `MaxSpeed` (steps/s) and then decelerates
+// to a stop at the end, just like `moveTo()` would. The whole table is
+// computed by the compiler and stored in flash, e.g.:
+//
+//   stepper.playTrajectory(TrajectoryGenerator<3200, 8000, 20000>::trajectory);
+template <uint32_t Length, uint32_t MaxSpeed, uint32_t Acceleration>
+struct TrajectoryGenerator {
+  static_assert(Length >= 2, "A trajectory needs at least 2 steps");
+  static_assert(Length <= TRAJECTORY_MAX_LENGTH, 
+                "Trajectory is longer than TRAJECTORY_MAX_LENGTH");
+  static_assert(MaxSpeed > 0 && Acceleration > 0, 
+                "Max speed and acceleration must be positive");
+  // The largest difference between the intervals is between the first and
+  // the second step. The deceleration mirrors it with the opposite sign,
+  // which only fits into int16_t if it's above -32768.
+  static_assert(TrajectoryMath::delta(0, Length, MaxSpeed, Acceleration) > -32768,
+                "Intervals change too quickly for the deltas to fit into "
+                "int16_t, increase the acceleration");
+
+  typedef TrajectoryDeltas<Length, MaxSpeed, Acceleration, 
+                           typename TrajectoryMakeIndices<Length - 1>::type> Deltas;
+
+  static constexpr StepTrajectory trajectory = {
+    Length,
+    TrajectoryMath::roundedInterval(0, Length, MaxSpeed, Acceleration),
+    TrajectoryMath::roundedInterval(Length - 1, Length, MaxSpeed, Acceleration),
+    Deltas::deltas
+  };
+};
+
+template <uint32_t Length, uint32_t MaxSpeed, uint32_t Acceleration>
+constexpr StepTrajectory TrajectoryGenerator<Length, MaxSpeed, Acceleration>::trajectory;
+
+#endif